@@ -0,0 +1,34 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec3 FragPos;
+
+uniform vec3 viewPos;
+
+void main()
+{
+	// light
+	vec3 lightColor = vec3(0.8f, 0.8f, 0.8f);
+	vec3 lightPos = viewPos + vec3(0.f, 10.f, 0.f);
+
+	// ambient
+	float ambientStrength = 0.1;
+	vec3 ambient = ambientStrength * lightColor;
+
+	// diffuse
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(lightPos - FragPos);
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = diff * lightColor;
+
+	// specular
+	float specularStrength = 0.2;
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
+	vec3 specular = specularStrength * spec * lightColor;
+
+	vec3 result = ambient + diffuse + specular;
+	FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
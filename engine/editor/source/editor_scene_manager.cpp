@@ -573,7 +573,6 @@ namespace MiniEngine
 
     size_t EditorSceneManager::getGuidOfPickedMesh(const Vector2& picked_uv) const
     {
-        // return g_editor_global_context.m_render_system->getGuidOfPickedMesh(picked_uv);
-        return 0;
+        return g_editor_global_context.m_render_system->getGuidOfPickedMesh(picked_uv);
     }
 } // namespace MiniEngine
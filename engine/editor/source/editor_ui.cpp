@@ -573,11 +573,123 @@ namespace MiniEngine
             ImGui::DragInt("Bounce Limit", &m_rendering_init_info->BounceLimit, 1.f, 1.f, 1024.f, "%d", ImGuiSliderFlags_AlwaysClamp);
             ImGui::Checkbox("Impotance Samling", &m_rendering_init_info->ImportSample);
             ImGui::Checkbox("BVH", &m_rendering_init_info->BVH);
+            if (m_rendering_init_info->BVH)
+            {
+                ImGui::Combo("Builder", &m_rendering_init_info->BVHBuilder, "SAH\0LBVH\0SBVH\0");
+                if (m_rendering_init_info->BVHBuilder == static_cast<int>(PathTracing::BVHBuilderType::LBVH))
+                    ImGui::Checkbox("Treelet Restructure", &m_rendering_init_info->Restructure);
+                if (m_rendering_init_info->BVHBuilder == static_cast<int>(PathTracing::BVHBuilderType::SBVH))
+                    ImGui::DragFloat("Split Budget", &m_rendering_init_info->SplitBudget, 0.05f, 0.f, 4.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::Checkbox("Cache BVH", &m_rendering_init_info->CacheBVH);
+                ImGui::Checkbox("Compress BVH", &m_rendering_init_info->CompressBVH);
+            }
+            ImGui::Checkbox("Page Textures", &m_rendering_init_info->PageTextures);
             ImGui::Checkbox("Multi-Thread", &m_rendering_init_info->MultiThread);
             ImGui::Checkbox("Denoise", &m_rendering_init_info->Denoise);
+            if (m_rendering_init_info->Denoise)
+            {
+                ImGui::Combo("Filter", &m_rendering_init_info->DenoiseFilter, "Open Image Denoise\0Edge-Aware\0");
+                ImGui::Checkbox("Denoise Preview", &m_rendering_init_info->DenoisePreview);
+            }
+
+            ImGui::Text("Environment");
+            static char environment_buf[128] = "";
+            if (environment_buf[0] == '\0' && m_rendering_init_info->EnvironmentMap[0] != '\0')
+                strcpy(environment_buf, m_rendering_init_info->EnvironmentMap);
+            if (ImGui::InputText("##Environment Map", environment_buf, 128))
+            {
+                strcpy(m_rendering_init_info->EnvironmentMap, environment_buf);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Browse##Environment Map"))
+            {
+                nfdchar_t *outPath = NULL;
+                nfdresult_t result = NFD_OpenDialog("hdr", NULL, &outPath);
+
+                if ( result == NFD_OKAY )
+                {
+                    strncpy(environment_buf, outPath, 127);
+                    strcpy(m_rendering_init_info->EnvironmentMap, environment_buf);
+                    free(outPath);
+                }
+                else if ( result == NFD_CANCEL ) {}
+                else {
+                    LOG_ERROR(NFD_GetError());
+                }
+            }
+            ImGui::DragFloat("Intensity", &m_rendering_init_info->EnvironmentIntensity, 0.01f, 0.f, 1000.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+
+            ImGui::Text("Post Processing");
+            ImGui::DragFloat("Exposure", &m_rendering_init_info->Exposure, 0.05f, -16.f, 16.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+            ImGui::Combo("Tone Mapper", &m_rendering_init_info->ToneMapper, "None\0Reinhard\0ACES\0");
+            ImGui::Checkbox("Dither", &m_rendering_init_info->Dither);
 
             ImGui::Text("Output");
             ImGui::Checkbox("Render to Disk", &m_rendering_init_info->Output);
+            ImGui::Combo("Format", &m_rendering_init_info->OutputFormat, "PNG\0HDR (Linear Float)\0QOI (Fast Lossless)\0");
+            ImGui::Checkbox("Render Sequence", &m_rendering_init_info->Sequence);
+            if (m_rendering_init_info->Sequence)
+            {
+                PathTracing::CameraPath &camera_path = g_editor_global_context.m_render_system->getPathTracer()->camera_path;
+                ImGui::DragFloat("Frame Rate", &m_rendering_init_info->FrameRate, 1.f, 1.f, 240.f, "%.0f", ImGuiSliderFlags_AlwaysClamp);
+                ImGui::Text("%d keyframes, %.2fs", static_cast<int>(camera_path.keyframes.size()), camera_path.getDuration());
+
+                // keyframes take the camera as it is set above
+                static float key_time = 0.f;
+                ImGui::DragFloat("Key Time", &key_time, 0.05f, 0.f, INFINITY, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+                if (ImGui::Button("Add Keyframe"))
+                {
+                    PathTracing::CameraKeyframe keyframe;
+                    keyframe.time = key_time;
+                    keyframe.position = m_camera->Position;
+                    keyframe.yaw = m_camera->Yaw;
+                    keyframe.pitch = m_camera->Pitch;
+                    keyframe.fov = m_camera->Zoom;
+                    keyframe.aperture = m_camera->Aperture;
+                    keyframe.focus_distance = m_camera->FocusDistance;
+                    camera_path.addKeyframe(keyframe);
+                    key_time += 1.f;
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Clear##Camera Path"))
+                {
+                    camera_path.clear();
+                    key_time = 0.f;
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Load##Camera Path"))
+                {
+                    nfdchar_t *outPath = NULL;
+                    nfdresult_t result = NFD_OpenDialog("json", NULL, &outPath);
+
+                    if ( result == NFD_OKAY )
+                    {
+                        camera_path.load(outPath);
+                        key_time = camera_path.getDuration() + 1.f;
+                        free(outPath);
+                    }
+                    else if ( result == NFD_CANCEL ) {}
+                    else {
+                        LOG_ERROR(NFD_GetError());
+                    }
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Save##Camera Path"))
+                {
+                    nfdchar_t *outPath = NULL;
+                    nfdresult_t result = NFD_SaveDialog("json", NULL, &outPath);
+
+                    if ( result == NFD_OKAY )
+                    {
+                        camera_path.save(outPath);
+                        free(outPath);
+                    }
+                    else if ( result == NFD_CANCEL ) {}
+                    else {
+                        LOG_ERROR(NFD_GetError());
+                    }
+                }
+            }
             static char buf[128] = "";
             if (ImGui::InputText("..", buf, 128))
             {
@@ -713,6 +825,12 @@ namespace MiniEngine
                     case 3:
                         ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.0f), "Error: Rendering process cancelled!");
                         break;
+                    case 4:
+                        ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.0f), "Error: The camera path has no keyframes!");
+                        break;
+                    case 5:
+                        ImGui::TextColored(ImVec4(1.f, 0.5f, 0.5f, 1.0f), "Error: A sequence is only rendered with Render to Disk!");
+                        break;
                     default:
                         break;
                     }
@@ -728,15 +846,31 @@ namespace MiniEngine
                         ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Building BVH...");
                         break;
                     case 2:
-                        ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Rendering (%.2f%%)...", 
+                        if (g_editor_global_context.m_render_system->getPathTracer()->in_sequence)
+                            ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Rendering frame %d/%d (%.2f%%)...",
+                                               g_editor_global_context.m_render_system->getPathTracer()->frame + 1,
+                                               g_editor_global_context.m_render_system->getPathTracer()->frame_count,
+                                               g_editor_global_context.m_render_system->getPathTracer()->progress);
+                        else
+                            ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Rendering (%.2f%%)...", 
                                                   g_editor_global_context.m_render_system->getPathTracer()->progress);
                         break;
                     case 3:
                         ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Denoising...");
                         break;
                     case 4:
-                        ImGui::TextColored(ImVec4(0.5f, 1.f, 0.5f, 1.0f), "Rendering is completed in %.2fs!", 
-                                                  g_editor_global_context.m_render_system->getPathTracer()->render_time);
+                        if (g_editor_global_context.m_render_system->getPathTracer()->in_sequence)
+                        {
+                            ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Finishing frame %d/%d...",
+                                               g_editor_global_context.m_render_system->getPathTracer()->frame + 1,
+                                               g_editor_global_context.m_render_system->getPathTracer()->frame_count);
+                            break;
+                        }
+                        ImGui::TextColored(ImVec4(0.5f, 1.f, 0.5f, 1.0f), "Rendering is completed in %.2fs (BVH %s in %.1fms)!", 
+                                                  g_editor_global_context.m_render_system->getPathTracer()->render_time,
+                                                  g_editor_global_context.m_render_system->getPathTracer()->bvh_refitted ? "refitted" :
+                                                  (g_editor_global_context.m_render_system->getPathTracer()->bvh_cached ? "loaded" : "built"),
+                                                  g_editor_global_context.m_render_system->getPathTracer()->build_time);
                         break;
                     default:
                         break;
@@ -775,6 +909,16 @@ namespace MiniEngine
                     {
                         m_error_code = 1;
                     }
+                    else if (m_rendering_init_info->Sequence &&
+                             g_editor_global_context.m_render_system->getPathTracer()->camera_path.empty())
+                    {
+                        m_error_code = 4;
+                    }
+                    else if (m_rendering_init_info->Sequence && !m_rendering_init_info->Output)
+                    {
+                        // the frames of a sequence are only seen in the files they are written to
+                        m_error_code = 5;
+                    }
                     else
                     {
                         m_error_code = 0;
@@ -787,7 +931,8 @@ namespace MiniEngine
             }
             else
             {
-                if (g_editor_global_context.m_render_system->getPathTracer()->state == 2)
+                if (g_editor_global_context.m_render_system->getPathTracer()->state == 2 ||
+                    (g_editor_global_context.m_render_system->getPathTracer()->in_sequence && !m_error_code))
                 {
                     if (ImGui::Button(" Stop "))
                     {
@@ -3,6 +3,9 @@
 #include "runtime/function/render/render_mesh.h"
 #include <glm/gtx/hash.hpp>
 
+#include <cstdint>
+#include <cstring>
+
 
 template<> struct std::hash<MiniEngine::Vertex> {
     size_t operator()(MiniEngine::Vertex const& vertex) const {
@@ -26,3 +29,38 @@ inline void hash_combine(std::size_t& seed, const T& v, Ts... rest)
         hash_combine(seed, rest...);
     }
 }
+
+// 64-bit hash of a byte range, consumed a word at a time so large model files hash at memory speed
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    const uint64_t m = 0x9e3779b97f4a7c15ull;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    auto mix = [](uint64_t w)
+    {
+        w *= 0xbf58476d1ce4e5b9ull;
+        w ^= w >> 31;
+        return w * 0x94d049bb133111ebull;
+    };
+
+    uint64_t h = seed ^ (size * m);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, bytes + i, 8);
+        h = (h ^ mix(w)) * m;
+        h ^= h >> 29;
+    }
+    if (i < size)
+    {
+        uint64_t w = 0;
+        std::memcpy(&w, bytes + i, size - i);
+        h = (h ^ mix(w)) * m;
+    }
+
+    h ^= h >> 32;
+    h *= m;
+    h ^= h >> 29;
+    return h;
+}
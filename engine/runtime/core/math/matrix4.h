@@ -118,6 +118,15 @@ namespace MiniEngine
             return res;
         }
 
+        // glm stores columns, m_mat is indexed [row][column]
+        glm::mat4 to_glm() const
+        {
+            return glm::mat4(m_mat[0][0], m_mat[1][0], m_mat[2][0], m_mat[3][0],
+                             m_mat[0][1], m_mat[1][1], m_mat[2][1], m_mat[3][1],
+                             m_mat[0][2], m_mat[1][2], m_mat[2][2], m_mat[3][2],
+                             m_mat[0][3], m_mat[1][3], m_mat[2][3], m_mat[3][3]);
+        }
+
         Matrix4x4() { operator=(IDENTITY); }
 
         Matrix4x4(const float (&float_array)[16])
@@ -17,20 +17,84 @@ namespace MiniEngine::PathTracing
             max = b;
         }
 
+        static AABB empty()
+        {
+            return AABB(vec3(INF), vec3(-INF));
+        }
+
+        void expand(const glm::vec3 &p)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        void expand(const AABB &box)
+        {
+            min = glm::min(min, box.min);
+            max = glm::max(max, box.max);
+        }
+
+        void intersect(const AABB &box)
+        {
+            min = glm::max(min, box.min);
+            max = glm::min(max, box.max);
+        }
+
+        bool isEmpty() const
+        {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        glm::vec3 center() const
+        {
+            return 0.5f * (min + max);
+        }
+
+        float area() const
+        {
+            vec3 d = glm::max(max - min, vec3(0.f));
+            return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        int maxExtent() const
+        {
+            vec3 d = max - min;
+            if (d.x > d.y && d.x > d.z)
+                return 0;
+            return d.y > d.z ? 1 : 2;
+        }
+
+        const glm::vec3 &bound(int i) const
+        {
+            return i ? max : min;
+        }
+
+        // Branchless slab test. The near and far planes of each slab are picked by the ray's sign bits,
+        // so there is neither a per-axis division nor an fmin/fmax pair. A zero direction component
+        // gives an infinite reciprocal: a ray outside that slab yields +/-inf and misses, a ray lying in
+        // a slab plane yields NaN which the NaN-discarding min/max below ignore.
         bool hit(const Ray &r, float t_min, float t_max) const
         {
-            for (int a = 0; a < 3; a++)
-            {
-                auto t0 = fmin((min[a] - r.origin[a]) / r.direction[a],
-                               (max[a] - r.origin[a]) / r.direction[a]);
-                auto t1 = fmax((min[a] - r.origin[a]) / r.direction[a],
-                               (max[a] - r.origin[a]) / r.direction[a]);
-                t_min = fmax(t0, t_min);
-                t_max = fmin(t1, t_max);
-                if (t_max <= t_min)
-                    return false;
-            }
-            return true;
+            float t_entry;
+            return hit(r, t_min, t_max, t_entry);
+        }
+
+        // same test, also reports where the ray enters the box for front to back ordering
+        bool hit(const Ray &r, float t_min, float t_max, float &t_entry) const
+        {
+            float tx0 = (bound(r.sign[0]).x - r.origin.x) * r.inv_direction.x;
+            float tx1 = (bound(1 - r.sign[0]).x - r.origin.x) * r.inv_direction.x;
+            float ty0 = (bound(r.sign[1]).y - r.origin.y) * r.inv_direction.y;
+            float ty1 = (bound(1 - r.sign[1]).y - r.origin.y) * r.inv_direction.y;
+            float tz0 = (bound(r.sign[2]).z - r.origin.z) * r.inv_direction.z;
+            float tz1 = (bound(1 - r.sign[2]).z - r.origin.z) * r.inv_direction.z;
+
+            // the slab distances go first so that a NaN one is dropped in favour of the running bound
+            t_entry = maxNum(tz0, maxNum(ty0, maxNum(tx0, t_min)));
+            // scale the exit distance up by 1 + 2 * gamma(3) to stay conservative under rounding
+            t_max = minNum(tz1, minNum(ty1, minNum(tx1, t_max))) * 1.0000004f;
+
+            return t_entry <= t_max;
         }
 
         static AABB getSurroundingBox(AABB box0, AABB box1)
@@ -45,6 +109,18 @@ namespace MiniEngine::PathTracing
 
             return AABB(small, big);
         }
+
+    private:
+        // return b when a is NaN, compiles to a single minss/maxss
+        static inline float minNum(float a, float b)
+        {
+            return a < b ? a : b;
+        }
+
+        static inline float maxNum(float a, float b)
+        {
+            return a > b ? a : b;
+        }
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,687 @@
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/sah_builder.h"
+#include "runtime/function/render/pathtracing/acc_struct/lbvh_builder.h"
+#include "runtime/function/render/pathtracing/acc_struct/sbvh_builder.h"
+#include "runtime/function/render/pathtracing/primitive/primitive_set.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace MiniEngine::PathTracing
+{
+    BVH::BVH(const HittableList &list, const BVHBuildSettings &settings) : objects(list.objects)
+    {
+        build(settings);
+    }
+
+    BVH::BVH(const HittableList &list, vector<BVHNode> &&prebuilt_nodes, vector<uint32_t> &&prebuilt_prim_indices)
+        : objects(list.objects), nodes(std::move(prebuilt_nodes)), prim_indices(std::move(prebuilt_prim_indices))
+    {
+        build_cost = getCost();
+    }
+
+    BVH::BVH(const PrimitiveSet &set, const BVHBuildSettings &settings) : primitives(&set)
+    {
+        build(settings);
+    }
+
+    BVH::BVH(const PrimitiveSet &set, vector<BVHNode> &&prebuilt_nodes, vector<uint32_t> &&prebuilt_prim_indices)
+        : primitives(&set), nodes(std::move(prebuilt_nodes)), prim_indices(std::move(prebuilt_prim_indices))
+    {
+        build_cost = getCost();
+    }
+
+    void BVH::build(const BVHBuildSettings &settings)
+    {
+        // the builders see primitives by slot, leaves are switched over to references afterwards
+        uint32_t count = getPrimitiveCount();
+        vector<AABB> prim_bounds(count);
+        tbb::parallel_for(uint32_t(0), count,
+                          [&](uint32_t i)
+                          {
+                              if (!aabbPrimitive(getPrimitiveRef(i), prim_bounds[i]))
+                                  std::cerr << "No bounding box in BVH constructor.\n";
+                          });
+
+        switch (settings.builder)
+        {
+        case BVHBuilderType::LBVH:
+            LBVHBuilder(prim_bounds).build(nodes, prim_indices, settings.restructure);
+            break;
+        case BVHBuilderType::SBVH:
+        {
+            auto split = [this](uint32_t prim, int axis, float position, const AABB &box, AABB &left, AABB &right)
+            {
+                uint32_t ref = getPrimitiveRef(prim);
+                if (primitives)
+                    primitives->splitPrimitive(ref, axis, position, box, left, right);
+                else
+                    objects[ref]->splitAABB(axis, position, box, left, right);
+            };
+            SBVHBuilder(split, prim_bounds, settings.split_budget).build(nodes, prim_indices);
+            break;
+        }
+        case BVHBuilderType::SAH:
+        default:
+            SAHBuilder(prim_bounds).build(nodes, prim_indices);
+            break;
+        }
+
+        if (primitives)
+        {
+            for (auto &prim : prim_indices)
+                prim = primitives->getId(prim);
+        }
+
+        build_cost = getCost();
+    }
+
+    uint32_t BVH::getPrimitiveCount() const
+    {
+        return primitives ? primitives->size() : static_cast<uint32_t>(objects.size());
+    }
+
+    uint32_t BVH::getPrimitiveRef(uint32_t slot) const
+    {
+        return primitives ? primitives->getId(slot) : slot;
+    }
+
+    uint32_t BVH::getPrimitiveSlot(uint32_t ref) const
+    {
+        return primitives ? primitives->getSlot(ref) : ref;
+    }
+
+    bool BVH::hitPrimitive(uint32_t ref, const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        return primitives ? primitives->hitPrimitive(ref, r, t_min, t_max, rec) : objects[ref]->hit(r, t_min, t_max, rec);
+    }
+
+    bool BVH::aabbPrimitive(uint32_t ref, AABB &bounding_box) const
+    {
+        return primitives ? primitives->aabbPrimitive(ref, bounding_box) : objects[ref]->aabb(bounding_box);
+    }
+
+    bool BVH::getTrianglePrimitive(uint32_t ref, vec3 &v0, vec3 &v1, vec3 &v2) const
+    {
+        return primitives ? primitives->getTrianglePrimitive(ref, v0, v1, v2) : objects[ref]->getTriangle(v0, v1, v2);
+    }
+
+    const Hittable *BVH::getPrimitive(uint32_t ref) const
+    {
+        return primitives ? primitives->get(ref) : objects[ref].get();
+    }
+
+    float BVH::getCost() const
+    {
+        if (nodes.empty())
+            return 0.f;
+
+        // relative to the summed primitive areas rather than the root, so a growing scene does not hide a degrading tree
+        float cost = 0.f;
+        float prim_area = 0.f;
+        for (const auto &node : nodes)
+        {
+            cost += node.box.area() * (node.count == 0 ? BVH_TRAVERSAL_COST : BVH_INTERSECT_COST * node.count);
+            for (uint32_t k = node.offset; node.count > 0 && k < node.offset + node.count; ++k)
+            {
+                AABB box;
+                if (aabbPrimitive(prim_indices[k], box))
+                    prim_area += box.area();
+            }
+        }
+
+        return cost / fmax(prim_area, 1e-20f);
+    }
+
+    bool BVH::refit(const vector<uint32_t> &moved_objects, float max_cost_ratio)
+    {
+        // the quantized boxes cannot be updated in place
+        if (compressed || nodes.empty())
+            return false;
+
+        uint32_t count = getPrimitiveCount();
+        vector<uint8_t> moved(count, 0);
+        for (uint32_t object : moved_objects)
+        {
+            uint32_t slot = getPrimitiveSlot(object);
+            if (slot < count)
+                moved[slot] = 1;
+        }
+
+        // both children follow their parent in the layout, so a reverse sweep updates them first
+        vector<uint8_t> dirty(nodes.size(), 0);
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            BVHNode &node = nodes[i];
+            if (node.count == 0)
+            {
+                dirty[i] = dirty[i + 1] | dirty[node.offset];
+                if (dirty[i])
+                {
+                    node.box = nodes[i + 1].box;
+                    node.box.expand(nodes[node.offset].box);
+                }
+                continue;
+            }
+
+            for (uint32_t k = node.offset; k < node.offset + node.count; ++k)
+                dirty[i] |= moved[getPrimitiveSlot(prim_indices[k])];
+            if (!dirty[i])
+                continue;
+
+            node.box = AABB::empty();
+            for (uint32_t k = node.offset; k < node.offset + node.count; ++k)
+            {
+                AABB box;
+                if (aabbPrimitive(prim_indices[k], box))
+                    node.box.expand(box);
+            }
+        }
+
+        if (!triangle_blocks.empty())
+            packLeaves();
+
+        return getCost() <= build_cost * max_cost_ratio;
+    }
+
+    bool BVH::aabb(AABB &bounding_box) const
+    {
+        if (compressed)
+        {
+            bounding_box = root_box;
+            return true;
+        }
+
+        if (nodes.empty())
+            return false;
+
+        bounding_box = nodes[0].box;
+        return true;
+    }
+
+    // Quantize box inside parent, rounding each plane outwards until the decoded box encloses it. The ends of the
+    // range decode exactly and the parent encloses box, so the search always terminates inside [0, 255]. The
+    // targets are moved one ulp outwards to tolerate a contracted multiply-add in the traversal decode.
+    static void quantizeBox(const AABB &box, const AABB &parent, const vec3 &scale, CompressedBVHNode &node, int c)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = parent.max[axis] - parent.min[axis];
+            if (extent <= 0)
+            {
+                node.qmin[c][axis] = 0;
+                node.qmax[c][axis] = 255;
+                continue;
+            }
+
+            float lo_target = std::nextafter(box.min[axis], -INF);
+            float hi_target = std::nextafter(box.max[axis], INF);
+
+            int lo = std::clamp(static_cast<int>(std::floor((box.min[axis] - parent.min[axis]) / extent * 255.f)), 0, 255);
+            while (lo > 0 && parent.min[axis] + lo * scale[axis] > lo_target)
+                --lo;
+
+            int hi = std::clamp(static_cast<int>(std::ceil((box.max[axis] - parent.min[axis]) / extent * 255.f)), lo, 255);
+            while (hi < 255 && parent.max[axis] - (255 - hi) * scale[axis] < hi_target)
+                ++hi;
+
+            node.qmin[c][axis] = static_cast<uint8_t>(lo);
+            node.qmax[c][axis] = static_cast<uint8_t>(hi);
+        }
+    }
+
+    BVH::Subtree BVH::getSubtree(uint32_t node) const
+    {
+        return {nodes[node].box, node, nodes[node].offset, nodes[node].count};
+    }
+
+    bool BVH::compress()
+    {
+        if (compressed || nodes.empty())
+            return compressed;
+
+        if (prim_indices.size() > COMPRESSED_OFFSET_MASK)
+        {
+            std::cerr << "Too many primitive references to compress the BVH.\n";
+            return false;
+        }
+
+        root_box = nodes[0].box;
+        compressed_nodes.clear();
+        compressed_nodes.reserve(nodes.size() / 2 + 1);
+
+        Subtree root = getSubtree(0);
+        if (root.count > 0 && root.count <= COMPRESSED_LEAF_SIZE)
+            root_ref = COMPRESSED_LEAF_FLAG | (root.count - 1) << COMPRESSED_COUNT_SHIFT | root.offset;
+        else
+            root_ref = compressSubtree(root, root_box);
+
+        compressed = true;
+        vector<BVHNode>().swap(nodes);
+
+        // oversized leaves were cut into slices, which start at new entries
+        if (!triangle_blocks.empty())
+            packLeaves();
+        return true;
+    }
+
+    uint32_t BVH::compressSubtree(const Subtree &tree, const AABB &decoded_box)
+    {
+        Subtree children[2];
+        if (tree.count > 0)
+        {
+            // a leaf beyond the reference limit is cut in halves under two copies of its box
+            uint32_t half = tree.count / 2;
+            children[0] = {tree.box, 0, tree.offset, half};
+            children[1] = {tree.box, 0, tree.offset + half, tree.count - half};
+        }
+        else
+        {
+            children[0] = getSubtree(tree.node + 1);
+            children[1] = getSubtree(tree.offset);
+        }
+
+        uint32_t index = static_cast<uint32_t>(compressed_nodes.size());
+        compressed_nodes.emplace_back();
+
+        vec3 scale = (decoded_box.max - decoded_box.min) * (1.f / 255.f);
+        for (int c = 0; c < 2; ++c)
+        {
+            quantizeBox(children[c].box, decoded_box, scale, compressed_nodes[index], c);
+
+            uint32_t ref;
+            if (children[c].count > 0 && children[c].count <= COMPRESSED_LEAF_SIZE)
+                ref = COMPRESSED_LEAF_FLAG | (children[c].count - 1) << COMPRESSED_COUNT_SHIFT | children[c].offset;
+            else
+                ref = compressSubtree(children[c], compressed_nodes[index].decode(c, decoded_box, scale));
+
+            compressed_nodes[index].child[c] = ref;
+        }
+
+        return index;
+    }
+
+    bool BVH::packLeaves()
+    {
+        triangle_blocks.clear();
+        leaf_blocks.assign(prim_indices.size(), NO_TRIANGLE_BLOCK);
+
+        if (compressed)
+        {
+            auto pack_ref = [this](uint32_t ref)
+            {
+                if (ref & COMPRESSED_LEAF_FLAG)
+                    packLeaf(ref & COMPRESSED_OFFSET_MASK, ((ref & ~COMPRESSED_LEAF_FLAG) >> COMPRESSED_COUNT_SHIFT) + 1);
+            };
+            pack_ref(root_ref);
+            for (const auto &node : compressed_nodes)
+            {
+                pack_ref(node.child[0]);
+                pack_ref(node.child[1]);
+            }
+        }
+        else
+        {
+            for (const auto &node : nodes)
+            {
+                if (node.count > 0)
+                    packLeaf(node.offset, node.count);
+            }
+        }
+
+        // nothing to pack, e.g. a top level over instances
+        if (triangle_blocks.empty())
+        {
+            vector<uint32_t>().swap(leaf_blocks);
+            return false;
+        }
+        return true;
+    }
+
+    void BVH::packLeaf(uint32_t offset, uint32_t count)
+    {
+        vec3 v[3];
+        for (uint32_t k = offset; k < offset + count; ++k)
+        {
+            if (!getTrianglePrimitive(prim_indices[k], v[0], v[1], v[2]))
+                return;
+        }
+
+        leaf_blocks[offset] = static_cast<uint32_t>(triangle_blocks.size());
+        for (uint32_t first = 0; first < count; first += TRIANGLE_BLOCK_WIDTH)
+        {
+            TriangleBlock block = {};
+            for (int lane = 0; lane < TRIANGLE_BLOCK_WIDTH; ++lane)
+            {
+                block.prim[lane] = NO_TRIANGLE_BLOCK;
+                if (first + lane >= count)
+                    continue;
+
+                block.prim[lane] = prim_indices[offset + first + lane];
+                getTrianglePrimitive(block.prim[lane], v[0], v[1], v[2]);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    block.v0[axis][lane] = v[0][axis];
+                    block.edge1[axis][lane] = v[1][axis] - v[0][axis];
+                    block.edge2[axis][lane] = v[2][axis] - v[0][axis];
+                }
+            }
+            triangle_blocks.push_back(block);
+        }
+    }
+
+    // Moller-Trumbore on every lane of a block, with the same rejection rules as Triangle::hit. Lanes that miss
+    // get an infinite distance. A block is one SSE register wide, other targets run the same arithmetic per lane.
+#if defined(__SSE2__) || defined(_M_X64)
+    static_assert(TRIANGLE_BLOCK_WIDTH == 4, "intersectBlock handles a block in one SSE register");
+
+    static void intersectBlock(const TriangleBlock &block, const Ray &r, float t_min, float t_max,
+                               float t[TRIANGLE_BLOCK_WIDTH], float u[TRIANGLE_BLOCK_WIDTH], float v[TRIANGLE_BLOCK_WIDTH])
+    {
+        const __m128 dx = _mm_set1_ps(r.direction.x), dy = _mm_set1_ps(r.direction.y), dz = _mm_set1_ps(r.direction.z);
+
+        const __m128 e1x = _mm_load_ps(block.edge1[0]), e1y = _mm_load_ps(block.edge1[1]), e1z = _mm_load_ps(block.edge1[2]);
+        const __m128 e2x = _mm_load_ps(block.edge2[0]), e2y = _mm_load_ps(block.edge2[1]), e2z = _mm_load_ps(block.edge2[2]);
+
+        // q = direction x edge2
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, qx), _mm_mul_ps(e1y, qy)), _mm_mul_ps(e1z, qz));
+        __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(r.origin.x), _mm_load_ps(block.v0[0]));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(r.origin.y), _mm_load_ps(block.v0[1]));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(r.origin.z), _mm_load_ps(block.v0[2]));
+        __m128 lane_u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, qx), _mm_mul_ps(sy, qy)), _mm_mul_ps(sz, qz)), inv_det);
+
+        // k = s x edge1
+        __m128 kx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 ky = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 kz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 lane_v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, kx), _mm_mul_ps(dy, ky)), _mm_mul_ps(dz, kz)), inv_det);
+        __m128 lane_t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, kx), _mm_mul_ps(e2y, ky)), _mm_mul_ps(e2z, kz)), inv_det);
+
+        // NaN lanes fail every comparison and miss, as in the scalar test
+        const __m128 zero = _mm_setzero_ps();
+        __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+        __m128 hit = _mm_cmpge_ps(abs_det, _mm_set1_ps(EPS * EPS));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(lane_u, zero), _mm_cmpge_ps(lane_v, zero)));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(lane_u, lane_v), _mm_set1_ps(1.f)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(lane_t, _mm_set1_ps(t_min)), _mm_cmple_ps(lane_t, _mm_set1_ps(t_max))));
+
+        _mm_storeu_ps(t, _mm_or_ps(_mm_and_ps(hit, lane_t), _mm_andnot_ps(hit, _mm_set1_ps(INF))));
+        _mm_storeu_ps(u, lane_u);
+        _mm_storeu_ps(v, lane_v);
+    }
+#else
+    static void intersectBlock(const TriangleBlock &block, const Ray &r, float t_min, float t_max,
+                               float t[TRIANGLE_BLOCK_WIDTH], float u[TRIANGLE_BLOCK_WIDTH], float v[TRIANGLE_BLOCK_WIDTH])
+    {
+        const float dx = r.direction.x, dy = r.direction.y, dz = r.direction.z;
+        const float ox = r.origin.x, oy = r.origin.y, oz = r.origin.z;
+
+        for (int lane = 0; lane < TRIANGLE_BLOCK_WIDTH; ++lane)
+        {
+            const float e1x = block.edge1[0][lane], e1y = block.edge1[1][lane], e1z = block.edge1[2][lane];
+            const float e2x = block.edge2[0][lane], e2y = block.edge2[1][lane], e2z = block.edge2[2][lane];
+
+            // q = direction x edge2
+            float qx = dy * e2z - dz * e2y;
+            float qy = dz * e2x - dx * e2z;
+            float qz = dx * e2y - dy * e2x;
+            float det = e1x * qx + e1y * qy + e1z * qz;
+            float inv_det = 1.f / det;
+
+            float sx = ox - block.v0[0][lane];
+            float sy = oy - block.v0[1][lane];
+            float sz = oz - block.v0[2][lane];
+            float lane_u = (sx * qx + sy * qy + sz * qz) * inv_det;
+
+            // k = s x edge1
+            float kx = sy * e1z - sz * e1y;
+            float ky = sz * e1x - sx * e1z;
+            float kz = sx * e1y - sy * e1x;
+            float lane_v = (dx * kx + dy * ky + dz * kz) * inv_det;
+            float lane_t = (e2x * kx + e2y * ky + e2z * kz) * inv_det;
+
+            bool hit = (std::fabs(det) >= EPS * EPS) & (lane_u >= 0.f) & (lane_v >= 0.f) & (lane_u + lane_v <= 1.f) &
+                       (lane_t >= t_min) & (lane_t <= t_max);
+            t[lane] = hit ? lane_t : INF;
+            u[lane] = lane_u;
+            v[lane] = lane_v;
+        }
+    }
+
+#endif
+
+    bool BVH::hitLeaf(uint32_t offset, uint32_t count, const Ray &r, float t_min, float &t_max, HitRecord &rec) const
+    {
+        uint32_t first_block = leaf_blocks.empty() ? NO_TRIANGLE_BLOCK : leaf_blocks[offset];
+        if (first_block != NO_TRIANGLE_BLOCK)
+        {
+            // closest lane over all blocks of the leaf
+            uint32_t closest = NO_TRIANGLE_BLOCK;
+            float closest_t = INF, closest_u = 0.f, closest_v = 0.f;
+            uint32_t last_block = first_block + (count + TRIANGLE_BLOCK_WIDTH - 1) / TRIANGLE_BLOCK_WIDTH;
+            for (uint32_t b = first_block; b < last_block; ++b)
+            {
+                float t[TRIANGLE_BLOCK_WIDTH], u[TRIANGLE_BLOCK_WIDTH], v[TRIANGLE_BLOCK_WIDTH];
+                intersectBlock(triangle_blocks[b], r, t_min, t_max, t, u, v);
+                for (int lane = 0; lane < TRIANGLE_BLOCK_WIDTH; ++lane)
+                {
+                    if (t[lane] < closest_t)
+                    {
+                        closest = triangle_blocks[b].prim[lane];
+                        closest_t = t[lane];
+                        closest_u = u[lane];
+                        closest_v = v[lane];
+                    }
+                }
+                t_max = fmin(t_max, closest_t);
+            }
+
+            if (closest == NO_TRIANGLE_BLOCK)
+                return false;
+
+            rec.t = closest_t;
+            rec.u = closest_u;
+            rec.v = closest_v;
+            rec.prim = rec.object = getPrimitive(closest);
+            return true;
+        }
+
+        bool hit_anything = false;
+        for (uint32_t i = offset; i < offset + count; ++i)
+        {
+            if (hitPrimitive(prim_indices[i], r, t_min, t_max, rec))
+            {
+                hit_anything = true;
+                t_max = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    bool BVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (compressed)
+            return hitCompressed(r, t_min, t_max, rec);
+
+        if (nodes.empty())
+            return false;
+
+        uint32_t stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        uint32_t index = 0;
+        bool hit_anything = false;
+
+        while (true)
+        {
+            const BVHNode &node = nodes[index];
+
+            if (node.box.hit(r, t_min, t_max))
+            {
+                if (node.count == 0)
+                {
+                    // visit the near child first and defer the far one
+                    if (r.sign[node.axis])
+                    {
+                        stack[stack_size++] = index + 1;
+                        index = node.offset;
+                    }
+                    else
+                    {
+                        stack[stack_size++] = node.offset;
+                        index = index + 1;
+                    }
+                    continue;
+                }
+
+                hit_anything |= hitLeaf(node.offset, node.count, r, t_min, t_max, rec);
+            }
+
+            if (stack_size == 0)
+                break;
+            index = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    bool BVH::occludedLeaf(uint32_t offset, uint32_t count, const Ray &r, float t_min, float t_max) const
+    {
+        uint32_t first_block = leaf_blocks.empty() ? NO_TRIANGLE_BLOCK : leaf_blocks[offset];
+        if (first_block != NO_TRIANGLE_BLOCK)
+        {
+            uint32_t last_block = first_block + (count + TRIANGLE_BLOCK_WIDTH - 1) / TRIANGLE_BLOCK_WIDTH;
+            for (uint32_t b = first_block; b < last_block; ++b)
+            {
+                float t[TRIANGLE_BLOCK_WIDTH], u[TRIANGLE_BLOCK_WIDTH], v[TRIANGLE_BLOCK_WIDTH];
+                intersectBlock(triangle_blocks[b], r, t_min, t_max, t, u, v);
+                for (int lane = 0; lane < TRIANGLE_BLOCK_WIDTH; ++lane)
+                {
+                    if (t[lane] < INF)
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        for (uint32_t i = offset; i < offset + count; ++i)
+        {
+            HitRecord rec;
+            uint32_t ref = prim_indices[i];
+            if (primitives ? primitives->hitPrimitive(ref, r, t_min, t_max, rec) : objects[ref]->occluded(r, t_min, t_max))
+                return true;
+        }
+        return false;
+    }
+
+    bool BVH::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (compressed)
+        {
+            HitRecord rec;
+            return hitCompressed(r, t_min, t_max, rec);
+        }
+
+        if (nodes.empty())
+            return false;
+
+        // any hit ends the walk, so the children are taken in layout order
+        uint32_t stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        uint32_t index = 0;
+
+        while (true)
+        {
+            const BVHNode &node = nodes[index];
+
+            if (node.box.hit(r, t_min, t_max))
+            {
+                if (node.count == 0)
+                {
+                    stack[stack_size++] = node.offset;
+                    index = index + 1;
+                    continue;
+                }
+
+                if (occludedLeaf(node.offset, node.count, r, t_min, t_max))
+                    return true;
+            }
+
+            if (stack_size == 0)
+                break;
+            index = stack[--stack_size];
+        }
+
+        return false;
+    }
+
+    bool BVH::hitCompressed(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (!root_box.hit(r, t_min, t_max))
+            return false;
+
+        // child boxes are decoded from the box of their parent, so it travels with every deferred node
+        struct StackEntry
+        {
+            AABB box;
+            uint32_t node;
+            float t_entry;
+        };
+
+        StackEntry stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        uint32_t ref = root_ref;
+        AABB box = root_box;
+        bool hit_anything = false;
+
+        while (true)
+        {
+            if (ref & COMPRESSED_LEAF_FLAG)
+            {
+                hit_anything |= hitLeaf(ref & COMPRESSED_OFFSET_MASK, ((ref & ~COMPRESSED_LEAF_FLAG) >> COMPRESSED_COUNT_SHIFT) + 1, r, t_min, t_max, rec);
+            }
+            else
+            {
+                const CompressedBVHNode &node = compressed_nodes[ref];
+                vec3 scale = (box.max - box.min) * (1.f / 255.f);
+
+                AABB child_boxes[2] = {node.decode(0, box, scale), node.decode(1, box, scale)};
+                float t_entry[2];
+                bool hit_child[2] = {child_boxes[0].hit(r, t_min, t_max, t_entry[0]), child_boxes[1].hit(r, t_min, t_max, t_entry[1])};
+
+                if (hit_child[0] || hit_child[1])
+                {
+                    // continue with the near child and defer the far one
+                    int near = (hit_child[0] && hit_child[1]) ? (t_entry[1] < t_entry[0] ? 1 : 0) : (hit_child[0] ? 0 : 1);
+                    if (hit_child[0] && hit_child[1])
+                        stack[stack_size++] = {child_boxes[1 - near], node.child[1 - near], t_entry[1 - near]};
+
+                    ref = node.child[near];
+                    box = child_boxes[near];
+                    continue;
+                }
+            }
+
+            // skip deferred nodes that start beyond the closest hit found since they were pushed
+            while (stack_size > 0 && stack[stack_size - 1].t_entry > t_max)
+                --stack_size;
+            if (stack_size == 0)
+                break;
+
+            --stack_size;
+            ref = stack[stack_size].node;
+            box = stack[stack_size].box;
+        }
+
+        return hit_anything;
+    }
+}
@@ -3,108 +3,212 @@
 #include "runtime/function/render/pathtracing/common/util.h"
 #include "runtime/function/render/pathtracing/common/hittable.h"
 
+#include <algorithm>
+#include <cstdint>
+
 namespace MiniEngine::PathTracing
 {
-    class BVH : public Hittable
+    class PrimitiveSet;
+
+    // Build constants shared by all builders
+    const int BVH_LEAF_SIZE = 4;
+    const int BVH_STACK_SIZE = 128;
+    // past this depth the builders only split at the median of the primitive count, so no leaf lies deeper than
+    // BVH_MAX_DEPTH + 32. compress() cuts a leaf into at most 2^12 slices, and the traversal stacks defer one node
+    // per level, so the trees always fit the stacks.
+    const int BVH_MAX_DEPTH = 64;
+    static_assert(BVH_MAX_DEPTH + 32 + 12 < BVH_STACK_SIZE, "BVH traversal stack too small for the depth limit");
+    const float BVH_TRAVERSAL_COST = 1.f;
+    const float BVH_INTERSECT_COST = 1.f;
+    // a refitted tree whose SAH cost grew past this multiple of the cost after its build should be rebuilt
+    const float BVH_REFIT_COST_RATIO = 1.3f;
+
+    enum class BVHBuilderType : int
     {
-    public:
-        shared_ptr<Hittable> left;
-        shared_ptr<Hittable> right;
-        AABB box;
+        SAH = 0,  // binned surface area heuristic, best trace speed
+        LBVH = 1, // morton code linear BVH, build in milliseconds
+        SBVH = 2, // SAH with spatial splits, best for long thin triangles
+    };
 
-        BVH() = default;
-        BVH(const HittableList &list) : BVH(list.objects, 0, list.objects.size()) {}
-        BVH(const std::vector<shared_ptr<Hittable>> &src_objects, size_t start, size_t end)
-        {
-            auto objects = src_objects; // Create a modifiable array of the source scene objects
+    struct BVHBuildSettings
+    {
+        BVHBuilderType builder{BVHBuilderType::SAH};
+        bool restructure{true}; // treelet restructuring after the LBVH build
+        float split_budget{0.5f}; // SBVH: duplicate references allowed, as a fraction of the primitive count
+    };
 
-            int axis = static_cast<int>(linearRand(0, 3));
-            auto comparator = (axis == 0)   ? compareX
-                              : (axis == 1) ? compareY
-                                            : compareZ;
+    // Nodes are laid out depth first, the left child of an internal node directly follows it.
+    struct BVHNode
+    {
+        AABB box;
+        uint32_t offset; // internal node: index of the right child, leaf: first entry in prim_indices
+        uint16_t count;  // number of primitives, 0 for internal nodes
+        uint16_t axis;   // axis along which the right child lies further, used for front to back traversal
+    };
 
-            size_t object_span = end - start;
+    // Compressed layout: a node keeps only its two child boxes, quantized to 8 bits inside the decoded box of the
+    // node itself and rounded outwards, so decoded boxes always contain the exact ones. Leaves are folded into
+    // the child references, which makes a node 20 bytes for what took two to three 32 byte BVHNodes.
+    const uint32_t COMPRESSED_LEAF_FLAG = 0x80000000u;
+    const int COMPRESSED_COUNT_SHIFT = 27;
+    const uint32_t COMPRESSED_OFFSET_MASK = (1u << COMPRESSED_COUNT_SHIFT) - 1;
+    const uint32_t COMPRESSED_LEAF_SIZE = 16;
 
-            if (object_span == 1)
-            {
-                left = right = objects[start];
-            }
-            else if (object_span == 2)
-            {
-                if (comparator(objects[start], objects[start + 1]))
-                {
-                    left = objects[start];
-                    right = objects[start + 1];
-                }
-                else
-                {
-                    left = objects[start + 1];
-                    right = objects[start];
-                }
-            }
-            else
-            {
-                std::sort(objects.begin() + start, objects.begin() + end, comparator);
+    struct CompressedBVHNode
+    {
+        uint8_t qmin[2][3];
+        uint8_t qmax[2][3];
+        uint32_t child[2]; // internal child: node index, leaf: flag | (count - 1) << COMPRESSED_COUNT_SHIFT | first entry in prim_indices
 
-                auto mid = start + object_span / 2;
-                left = make_shared<BVH>(objects, start, mid);
-                right = make_shared<BVH>(objects, mid, end);
-            }
+        // 0 and 255 decode exactly to the bounds of the parent, with scale = parent extent / 255
+        AABB decode(int c, const AABB &parent, const vec3 &scale) const
+        {
+            vec3 lo(qmin[c][0], qmin[c][1], qmin[c][2]);
+            vec3 hi(255 - qmax[c][0], 255 - qmax[c][1], 255 - qmax[c][2]);
+            return AABB(parent.min + lo * scale, parent.max - hi * scale);
+        }
+    };
+
+    // Leaves made of triangles only are also stored as blocks of TRIANGLE_BLOCK_WIDTH triangles in SoA form, with
+    // the edges precomputed, so a leaf is intersected a block at a time in SSE registers. Unused lanes hold a
+    // degenerate triangle that never hits.
+    const int TRIANGLE_BLOCK_WIDTH = 4;
+    const uint32_t NO_TRIANGLE_BLOCK = 0xffffffffu;
 
-            AABB box_left, box_right;
+    struct alignas(16) TriangleBlock
+    {
+        float v0[3][TRIANGLE_BLOCK_WIDTH];
+        float edge1[3][TRIANGLE_BLOCK_WIDTH];
+        float edge2[3][TRIANGLE_BLOCK_WIDTH];
+        uint32_t prim[TRIANGLE_BLOCK_WIDTH]; // leaf entry of the triangle, NO_TRIANGLE_BLOCK for unused lanes
+    };
 
-            if (!left->aabb(box_left) || !right->aabb(box_right))
-                std::cerr << "No bounding box in BVH constructor.\n";
+    // A BVH over a list of objects, where prim_indices point into objects, or over a primitive set, where they hold
+    // tagged primitive ids and leaves dispatch on the id type instead of through the vtable.
+    class BVH : public Hittable
+    {
+    public:
+        vector<shared_ptr<Hittable>> objects;
+        const PrimitiveSet *primitives{nullptr}; // not owned, has to outlive the BVH
+        vector<BVHNode> nodes;
+        vector<uint32_t> prim_indices;
+        float build_cost{0.f};
+
+        // filled by compress(), which releases nodes
+        vector<CompressedBVHNode> compressed_nodes;
+        AABB root_box;
+        uint32_t root_ref{0};
+        bool compressed{false};
+
+        // filled by packLeaves(), leaf_blocks maps the first entry of a leaf in prim_indices to its first block
+        vector<TriangleBlock> triangle_blocks;
+        vector<uint32_t> leaf_blocks;
 
-            box = AABB::getSurroundingBox(box_left, box_right);
-        }
+        BVH() = default;
+        BVH(const HittableList &list, const BVHBuildSettings &settings = BVHBuildSettings());
+        // adopts a hierarchy built earlier over the same list, e.g. one loaded from the BVH cache
+        BVH(const HittableList &list, vector<BVHNode> &&prebuilt_nodes, vector<uint32_t> &&prebuilt_prim_indices);
+        BVH(const PrimitiveSet &set, const BVHBuildSettings &settings = BVHBuildSettings());
+        BVH(const PrimitiveSet &set, vector<BVHNode> &&prebuilt_nodes, vector<uint32_t> &&prebuilt_prim_indices);
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
         virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override { rec.prim->fillHit(r, rec); }
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
 
-    private:
-        inline static bool compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b, int axis)
-        {
-            AABB box_a;
-            AABB box_b;
+        // Leaf entries whose bounds pass overlaps(const AABB &), each reported once. Subtrees are skipped when
+        // their node box fails, so the test has to be conservative like a box or frustum overlap.
+        template <typename Overlaps>
+        void collect(Overlaps overlaps, vector<uint32_t> &refs) const;
 
-            if (!a->aabb(box_a) || !b->aabb(box_b))
-                std::cerr << "No bounding box in bvh node constructor.\n";
+        bool compress();
+        // Packs the triangle leaves into blocks, false if there are none. compress() and refit() keep them current.
+        bool packLeaves();
 
-            return box_a.min[axis] < box_b.min[axis];
-        }
+        // SAH cost of the tree relative to the summed areas of its primitives
+        float getCost() const;
+        // Updates the boxes above the given objects, or primitive ids, after they moved. The tree stays valid either way, false
+        // means it degraded past max_cost_ratio times its build cost and a rebuild would trace faster.
+        bool refit(const vector<uint32_t> &moved_objects, float max_cost_ratio = BVH_REFIT_COST_RATIO);
 
-        static bool compareX(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b)
+    private:
+        // a node of the uncompressed tree, or a slice of a leaf too large for a compressed reference
+        struct Subtree
         {
-            return compare(a, b, 0);
-        }
+            AABB box;
+            uint32_t node;
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        void build(const BVHBuildSettings &settings);
+
+        // access to a leaf entry, which is an index into objects or a primitive id
+        uint32_t getPrimitiveCount() const;
+        uint32_t getPrimitiveRef(uint32_t slot) const;
+        uint32_t getPrimitiveSlot(uint32_t ref) const;
+        bool hitPrimitive(uint32_t ref, const Ray &r, float t_min, float t_max, HitRecord &rec) const;
+        bool aabbPrimitive(uint32_t ref, AABB &bounding_box) const;
+        bool getTrianglePrimitive(uint32_t ref, vec3 &v0, vec3 &v1, vec3 &v2) const;
+        const Hittable *getPrimitive(uint32_t ref) const;
+
+        Subtree getSubtree(uint32_t node) const;
+        uint32_t compressSubtree(const Subtree &tree, const AABB &decoded_box);
+        bool hitCompressed(const Ray &r, float t_min, float t_max, HitRecord &rec) const;
+        void packLeaf(uint32_t offset, uint32_t count);
+        bool hitLeaf(uint32_t offset, uint32_t count, const Ray &r, float t_min, float &t_max, HitRecord &rec) const;
+        bool occludedLeaf(uint32_t offset, uint32_t count, const Ray &r, float t_min, float t_max) const;
+    };
 
-        static bool compareY(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b)
+    template <typename Overlaps>
+    void BVH::collect(Overlaps overlaps, vector<uint32_t> &refs) const
+    {
+        refs.clear();
+        if (compressed)
         {
-            return compare(a, b, 1);
+            // the quantized boxes only decode top down, test the primitives directly
+            for (uint32_t ref : prim_indices)
+            {
+                AABB box;
+                if (aabbPrimitive(ref, box) && overlaps(box))
+                    refs.push_back(ref);
+            }
         }
-
-        static bool compareZ(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b)
+        else if (!nodes.empty())
         {
-            return compare(a, b, 2);
-        }
-    };
-
-    bool BVH::aabb(AABB &bounding_box) const
-    {
-        bounding_box = box;
-        return true;
-    }
-
-    bool BVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
-    {
-        if (!box.hit(r, t_min, t_max))
-            return false;
+            // one deferred node per level like in hit(), so the depth limit of the builders bounds the stack
+            uint32_t stack[BVH_STACK_SIZE];
+            int stack_size = 0;
+            uint32_t index = 0;
+            while (true)
+            {
+                const BVHNode &node = nodes[index];
+                if (overlaps(node.box))
+                {
+                    if (node.count == 0)
+                    {
+                        stack[stack_size++] = node.offset;
+                        index = index + 1;
+                        continue;
+                    }
+
+                    for (uint32_t k = node.offset; k < node.offset + node.count; ++k)
+                    {
+                        AABB box;
+                        if (node.count == 1 || (aabbPrimitive(prim_indices[k], box) && overlaps(box)))
+                            refs.push_back(prim_indices[k]);
+                    }
+                }
 
-        bool hit_left = left->hit(r, t_min, t_max, rec);
-        bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+                if (stack_size == 0)
+                    break;
+                index = stack[--stack_size];
+            }
+        }
 
-        return hit_left || hit_right;
+        // spatial splits reference a primitive from several leaves
+        std::sort(refs.begin(), refs.end());
+        refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
     }
 
 }
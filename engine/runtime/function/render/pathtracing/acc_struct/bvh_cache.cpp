@@ -0,0 +1,199 @@
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
+#include "runtime/function/global/global_context.h"
+#include "runtime/resource/config_manager/config_manager.h"
+#include "runtime/platform/file_system/mapped_file.h"
+#include "runtime/core/base/hash.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+
+namespace MiniEngine::PathTracing
+{
+    static const uint32_t BVH_CACHE_MAGIC = 0x4856424d; // "MBVH"
+    static const uint64_t BVH_CACHE_ALIGNMENT = 64;
+
+    struct BVHCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint64_t triangle_count;
+        uint64_t node_count;
+        uint64_t index_count;
+        uint64_t triangle_offset;
+        uint64_t node_offset;
+        uint64_t index_offset;
+    };
+
+    static uint64_t alignSection(uint64_t offset)
+    {
+        return (offset + BVH_CACHE_ALIGNMENT - 1) & ~(BVH_CACHE_ALIGNMENT - 1);
+    }
+
+    static bool sectionInFile(uint64_t offset, uint64_t count, uint64_t stride, uint64_t file_size)
+    {
+        return offset <= file_size && count <= (file_size - offset) / stride;
+    }
+
+    template <typename T>
+    static void readSection(const unsigned char *data, uint64_t offset, uint64_t count, vector<T> &section)
+    {
+        section.resize(count);
+        if (count)
+            memcpy(section.data(), data + offset, count * sizeof(T));
+    }
+
+    template <typename T>
+    static void writeSection(std::ofstream &out, uint64_t offset, const vector<T> &section)
+    {
+        static const char padding[BVH_CACHE_ALIGNMENT] = {0};
+        out.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+        out.write(reinterpret_cast<const char *>(section.data()), static_cast<std::streamsize>(section.size() * sizeof(T)));
+    }
+
+    bool BVHCache::getKey(const Model &model, const BVHBuildSettings &settings, uint64_t &key)
+    {
+        MappedFile file;
+        if (!file.open(model.model_file))
+            return false;
+
+        key = hash_bytes(file.data(), file.size(), BVH_CACHE_VERSION);
+
+        auto combine = [&key](uint64_t value)
+        { key = hash_bytes(&value, sizeof(value), key); };
+
+        // the mesh layout decides which material every triangle ends up with
+        combine(model.meshes.size());
+        for (const auto &mesh : model.meshes)
+        {
+            combine(mesh.vertices.size());
+            combine(mesh.indices.size());
+        }
+
+        combine(static_cast<uint64_t>(settings.builder));
+        combine(settings.builder == BVHBuilderType::LBVH && settings.restructure);
+        if (settings.builder == BVHBuilderType::SBVH)
+        {
+            uint32_t budget_bits;
+            memcpy(&budget_bits, &settings.split_budget, sizeof(budget_bits));
+            combine(budget_bits);
+        }
+        combine(sizeof(PackedTriangle));
+        combine(sizeof(BVHNode));
+        return true;
+    }
+
+    std::filesystem::path BVHCache::getCacheFolder()
+    {
+        std::filesystem::path folder = g_runtime_global_context.m_config_manager->getCacheFolder();
+        if (folder.empty())
+            folder = g_runtime_global_context.m_config_manager->getRootFolder() / "cache";
+        return folder;
+    }
+
+    std::filesystem::path BVHCache::getCacheFile(const Model &model, uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "_%016" PRIx64 ".bvh", key);
+        return getCacheFolder() / (std::filesystem::path(model.model_file).stem().string() + name);
+    }
+
+    bool BVHCache::load(const std::filesystem::path &file, uint64_t key, vector<PackedTriangle> &triangles,
+                        vector<BVHNode> &nodes, vector<uint32_t> &prim_indices)
+    {
+        MappedFile mapped;
+        if (!mapped.open(file) || mapped.size() < sizeof(BVHCacheHeader))
+            return false;
+
+        BVHCacheHeader header;
+        memcpy(&header, mapped.data(), sizeof(header));
+        if (header.magic != BVH_CACHE_MAGIC || header.version != BVH_CACHE_VERSION || header.key != key)
+            return false;
+
+        if (!sectionInFile(header.triangle_offset, header.triangle_count, sizeof(PackedTriangle), mapped.size()) ||
+            !sectionInFile(header.node_offset, header.node_count, sizeof(BVHNode), mapped.size()) ||
+            !sectionInFile(header.index_offset, header.index_count, sizeof(uint32_t), mapped.size()))
+        {
+            std::cerr << "Truncated BVH cache " << file << ".\n";
+            return false;
+        }
+
+        readSection(mapped.data(), header.triangle_offset, header.triangle_count, triangles);
+        readSection(mapped.data(), header.node_offset, header.node_count, nodes);
+        readSection(mapped.data(), header.index_offset, header.index_count, prim_indices);
+
+        // a damaged file must not send the traversal out of bounds
+        bool valid = true;
+        for (size_t i = 0; i < nodes.size() && valid; ++i)
+        {
+            const BVHNode &node = nodes[i];
+            if (node.count == 0)
+                valid = node.offset > i && node.offset < nodes.size() && node.axis < 3;
+            else
+                valid = uint64_t(node.offset) + node.count <= prim_indices.size();
+        }
+        for (size_t i = 0; i < prim_indices.size() && valid; ++i)
+            valid = prim_indices[i] < triangles.size();
+
+        if (!valid)
+        {
+            std::cerr << "Corrupted BVH cache " << file << ".\n";
+            triangles.clear();
+            nodes.clear();
+            prim_indices.clear();
+        }
+        return valid;
+    }
+
+    bool BVHCache::save(const std::filesystem::path &file, uint64_t key, const vector<PackedTriangle> &triangles,
+                        const vector<BVHNode> &nodes, const vector<uint32_t> &prim_indices)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(file.parent_path(), error);
+
+        BVHCacheHeader header;
+        header.magic = BVH_CACHE_MAGIC;
+        header.version = BVH_CACHE_VERSION;
+        header.key = key;
+        header.triangle_count = triangles.size();
+        header.node_count = nodes.size();
+        header.index_count = prim_indices.size();
+        header.triangle_offset = alignSection(sizeof(header));
+        header.node_offset = alignSection(header.triangle_offset + triangles.size() * sizeof(PackedTriangle));
+        header.index_offset = alignSection(header.node_offset + nodes.size() * sizeof(BVHNode));
+
+        // write next to the target and rename, a concurrent or later load never sees a half written file
+        std::filesystem::path temp_file = file;
+        temp_file += ".tmp";
+        {
+            std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cerr << "Failed to write BVH cache " << temp_file << ".\n";
+                return false;
+            }
+
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            writeSection(out, header.triangle_offset, triangles);
+            writeSection(out, header.node_offset, nodes);
+            writeSection(out, header.index_offset, prim_indices);
+
+            if (!out)
+            {
+                out.close();
+                std::filesystem::remove(temp_file, error);
+                std::cerr << "Failed to write BVH cache " << temp_file << ".\n";
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temp_file, file, error);
+        if (error)
+        {
+            std::filesystem::remove(temp_file, error);
+            return false;
+        }
+        return true;
+    }
+}
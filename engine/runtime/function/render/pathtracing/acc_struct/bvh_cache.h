@@ -0,0 +1,36 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+#include "runtime/function/render/render_model.h"
+
+#include <filesystem>
+
+namespace MiniEngine::PathTracing
+{
+    // bump whenever PackedTriangle, BVHNode or the way a builder orders its output changes
+    const uint32_t BVH_CACHE_VERSION = 2;
+
+    // Triangle as the tracer consumes it, flattened out of the indexed meshes of a model
+    struct PackedTriangle
+    {
+        vec3 position[3];
+        vec2 texcoord[3];
+        uint32_t mesh; // index into Model::meshes, selects the material
+    };
+
+    // The packed triangles and the BVH over them are stored in <CacheFolder>/<model>_<key>.bvh. The key hashes the
+    // model file, its mesh layout, the build settings and the format version, so a stale file is never picked up.
+    // Sections are 64 byte aligned raw arrays behind a fixed header and can be used straight from a mapping.
+    class BVHCache
+    {
+    public:
+        static bool getKey(const Model &model, const BVHBuildSettings &settings, uint64_t &key);
+        static std::filesystem::path getCacheFolder();
+        static std::filesystem::path getCacheFile(const Model &model, uint64_t key);
+
+        static bool load(const std::filesystem::path &file, uint64_t key, vector<PackedTriangle> &triangles,
+                         vector<BVHNode> &nodes, vector<uint32_t> &prim_indices);
+        static bool save(const std::filesystem::path &file, uint64_t key, const vector<PackedTriangle> &triangles,
+                         const vector<BVHNode> &nodes, const vector<uint32_t> &prim_indices);
+    };
+}
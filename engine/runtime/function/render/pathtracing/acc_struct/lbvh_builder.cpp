@@ -0,0 +1,524 @@
+#include "runtime/function/render/pathtracing/acc_struct/lbvh_builder.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+#include "thirdparty/tbb/include/tbb/parallel_invoke.h"
+#include "thirdparty/tbb/include/tbb/parallel_reduce.h"
+#include "thirdparty/tbb/include/tbb/blocked_range.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace MiniEngine::PathTracing
+{
+    // subtrees closer to the root than this are processed as parallel tasks
+    static const int PARALLEL_DEPTH = 10;
+    // keys sorted per radix sort task
+    static const uint32_t SORT_BLOCK_SIZE = 1 << 16;
+
+    // spread the lower 10 bits so that two zero bits separate each of them
+    static inline uint32_t expandBits10(uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v * 0x00010001u) & 0xff0000ffu;
+        v = (v * 0x00000101u) & 0x0f00f00fu;
+        v = (v * 0x00000011u) & 0xc30c30c3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // spread the lower 21 bits so that two zero bits separate each of them
+    static inline uint64_t expandBits21(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x001f00000000ffffull;
+        v = (v | v << 16) & 0x001f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    static inline int countLeadingZeros(uint64_t x)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return 63 - static_cast<int>(index);
+#else
+        return __builtin_clzll(x);
+#endif
+    }
+
+    static inline int countTrailingZeros(uint32_t x)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(x);
+#endif
+    }
+
+    LBVHBuilder::LBVHBuilder(const vector<AABB> &prim_bounds) : bounds(prim_bounds)
+    {
+        prim_count = static_cast<uint32_t>(bounds.size());
+        // 10 bits per axis stop separating primitives in large scenes, switch to 21 bits there
+        code_bits = prim_count > (1u << 18) ? 63 : 30;
+    }
+
+    void LBVHBuilder::build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, bool restructure)
+    {
+        nodes.clear();
+        prim_indices.clear();
+
+        if (prim_count == 0)
+            return;
+
+        if (prim_count == 1)
+        {
+            nodes.push_back({bounds[0], 0, 1, 0});
+            prim_indices.push_back(0);
+            return;
+        }
+
+        computeMortonCodes();
+        sortMortonCodes();
+        buildHierarchy();
+
+        uint32_t node_count = 2 * prim_count - 1;
+        node_boxes.resize(node_count);
+        node_counts.resize(node_count);
+        node_costs.resize(node_count);
+        tbb::parallel_for(uint32_t(0), prim_count,
+                          [this](uint32_t i)
+                          {
+                              uint32_t leaf = prim_count - 1 + i;
+                              node_boxes[leaf] = bounds[sorted_prims[i]];
+                              node_counts[leaf] = 1;
+                              node_costs[leaf] = BVH_INTERSECT_COST * node_boxes[leaf].area();
+                          });
+        computeBounds(0, 0);
+
+        if (restructure)
+        {
+            for (int pass = 0; pass < RESTRUCTURE_PASSES; ++pass)
+                optimizeTreelets(0, TREELET_SIZE << pass, 0);
+        }
+
+        nodes.reserve(node_count);
+        prim_indices.reserve(prim_count);
+        emitNode(nodes, prim_indices, 0, 0);
+    }
+
+    void LBVHBuilder::computeMortonCodes()
+    {
+        AABB centroid_box = tbb::parallel_reduce(
+            tbb::blocked_range<uint32_t>(0, prim_count), AABB::empty(),
+            [this](const tbb::blocked_range<uint32_t> &range, AABB box)
+            {
+                for (uint32_t i = range.begin(); i != range.end(); ++i)
+                    box.expand(bounds[i].center());
+                return box;
+            },
+            [](AABB a, const AABB &b)
+            {
+                a.expand(b);
+                return a;
+            });
+
+        int axis_bits = code_bits / 3;
+        float cells = static_cast<float>(1u << axis_bits);
+        vec3 extent = centroid_box.max - centroid_box.min;
+        vec3 scale(extent.x > 0 ? cells / extent.x : 0.f,
+                   extent.y > 0 ? cells / extent.y : 0.f,
+                   extent.z > 0 ? cells / extent.z : 0.f);
+
+        codes.resize(prim_count);
+        sorted_prims.resize(prim_count);
+        tbb::parallel_for(uint32_t(0), prim_count,
+                          [&](uint32_t i)
+                          {
+                              vec3 cell = glm::clamp((bounds[i].center() - centroid_box.min) * scale, vec3(0.f), vec3(cells - 1));
+                              uint32_t x = static_cast<uint32_t>(cell.x);
+                              uint32_t y = static_cast<uint32_t>(cell.y);
+                              uint32_t z = static_cast<uint32_t>(cell.z);
+
+                              if (code_bits == 30)
+                                  codes[i] = (expandBits10(x) << 2) | (expandBits10(y) << 1) | expandBits10(z);
+                              else
+                                  codes[i] = (expandBits21(x) << 2) | (expandBits21(y) << 1) | expandBits21(z);
+                              sorted_prims[i] = i;
+                          });
+    }
+
+    void LBVHBuilder::sortMortonCodes()
+    {
+        // least significant digit radix sort with 8 bit digits, every block of keys
+        // builds its own histogram and scatters into its own slice of the output
+        vector<uint64_t> codes_swap(prim_count);
+        vector<uint32_t> prims_swap(prim_count);
+
+        uint32_t blocks = (prim_count + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+        vector<uint32_t> histograms(blocks * 256);
+
+        for (int shift = 0; shift < code_bits; shift += 8)
+        {
+            tbb::parallel_for(uint32_t(0), blocks,
+                              [&](uint32_t block)
+                              {
+                                  uint32_t *histogram = &histograms[block * 256];
+                                  std::fill(histogram, histogram + 256, 0);
+                                  uint32_t end = std::min(prim_count, (block + 1) * SORT_BLOCK_SIZE);
+                                  for (uint32_t i = block * SORT_BLOCK_SIZE; i < end; ++i)
+                                      histogram[(codes[i] >> shift) & 0xff]++;
+                              });
+
+            // exclusive scan in digit major order turns the counts into scatter offsets
+            uint32_t sum = 0;
+            for (uint32_t digit = 0; digit < 256; ++digit)
+            {
+                for (uint32_t block = 0; block < blocks; ++block)
+                {
+                    uint32_t count = histograms[block * 256 + digit];
+                    histograms[block * 256 + digit] = sum;
+                    sum += count;
+                }
+            }
+
+            tbb::parallel_for(uint32_t(0), blocks,
+                              [&](uint32_t block)
+                              {
+                                  uint32_t *offsets = &histograms[block * 256];
+                                  uint32_t end = std::min(prim_count, (block + 1) * SORT_BLOCK_SIZE);
+                                  for (uint32_t i = block * SORT_BLOCK_SIZE; i < end; ++i)
+                                  {
+                                      uint32_t dst = offsets[(codes[i] >> shift) & 0xff]++;
+                                      codes_swap[dst] = codes[i];
+                                      prims_swap[dst] = sorted_prims[i];
+                                  }
+                              });
+
+            codes.swap(codes_swap);
+            sorted_prims.swap(prims_swap);
+        }
+    }
+
+    int LBVHBuilder::delta(int i, int j) const
+    {
+        if (j < 0 || j >= static_cast<int>(prim_count))
+            return -1;
+
+        // duplicated codes are told apart by their position in the sorted order
+        uint64_t diff = codes[i] ^ codes[j];
+        if (diff == 0)
+            return 64 + countLeadingZeros(static_cast<uint64_t>(i ^ j));
+
+        return countLeadingZeros(diff);
+    }
+
+    void LBVHBuilder::buildHierarchy()
+    {
+        left.resize(prim_count - 1);
+        right.resize(prim_count - 1);
+
+        // every internal node finds its key range and split position independently
+        tbb::parallel_for(0, static_cast<int>(prim_count - 1),
+                          [this](int i)
+                          {
+                              int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+
+                              // upper bound of the range length, then binary search its other end
+                              int delta_min = delta(i, i - d);
+                              int l_max = 2;
+                              while (delta(i, i + l_max * d) > delta_min)
+                                  l_max *= 2;
+
+                              int l = 0;
+                              for (int t = l_max / 2; t >= 1; t /= 2)
+                              {
+                                  if (delta(i, i + (l + t) * d) > delta_min)
+                                      l += t;
+                              }
+                              int j = i + l * d;
+
+                              // binary search the position of the highest differing bit
+                              int delta_node = delta(i, j);
+                              int s = 0;
+                              for (int div = 2;; div *= 2)
+                              {
+                                  int t = (l + div - 1) / div;
+                                  if (delta(i, i + (s + t) * d) > delta_node)
+                                      s += t;
+                                  if (t <= 1)
+                                      break;
+                              }
+                              int split = i + s * d + std::min(d, 0);
+
+                              left[i] = std::min(i, j) == split ? prim_count - 1 + split : split;
+                              right[i] = std::max(i, j) == split + 1 ? prim_count + split : split + 1;
+                          });
+    }
+
+    void LBVHBuilder::updateNode(uint32_t node)
+    {
+        uint32_t l = left[node];
+        uint32_t r = right[node];
+
+        node_boxes[node] = AABB::getSurroundingBox(node_boxes[l], node_boxes[r]);
+        node_counts[node] = node_counts[l] + node_counts[r];
+
+        float area = node_boxes[node].area();
+        float cost = BVH_TRAVERSAL_COST * area + node_costs[l] + node_costs[r];
+        if (node_counts[node] <= BVH_LEAF_SIZE)
+            cost = fmin(cost, BVH_INTERSECT_COST * area * node_counts[node]);
+        node_costs[node] = cost;
+    }
+
+    void LBVHBuilder::computeBounds(uint32_t node, int depth)
+    {
+        if (isLeaf(node))
+            return;
+
+        if (depth < PARALLEL_DEPTH)
+        {
+            tbb::parallel_invoke([&]
+                                 { computeBounds(left[node], depth + 1); },
+                                 [&]
+                                 { computeBounds(right[node], depth + 1); });
+        }
+        else
+        {
+            computeBounds(left[node], depth + 1);
+            computeBounds(right[node], depth + 1);
+        }
+
+        updateNode(node);
+    }
+
+    void LBVHBuilder::optimizeTreelets(uint32_t node, uint32_t gamma, int depth)
+    {
+        // node counts shrink towards the leaves, so nothing below a small subtree qualifies either
+        if (isLeaf(node) || node_counts[node] < gamma)
+            return;
+
+        if (depth < PARALLEL_DEPTH)
+        {
+            tbb::parallel_invoke([&]
+                                 { optimizeTreelets(left[node], gamma, depth + 1); },
+                                 [&]
+                                 { optimizeTreelets(right[node], gamma, depth + 1); });
+        }
+        else
+        {
+            optimizeTreelets(left[node], gamma, depth + 1);
+            optimizeTreelets(right[node], gamma, depth + 1);
+        }
+
+        updateNode(node);
+        restructureTreelet(node);
+    }
+
+    void LBVHBuilder::restructureTreelet(uint32_t root)
+    {
+        // grow the treelet by repeatedly opening the leaf with the largest surface area
+        uint32_t treelet_leaves[TREELET_SIZE];
+        uint32_t treelet_nodes[TREELET_SIZE - 1];
+        int leaf_count = 2;
+        int node_count = 1;
+        treelet_leaves[0] = left[root];
+        treelet_leaves[1] = right[root];
+        treelet_nodes[0] = root;
+
+        while (leaf_count < TREELET_SIZE)
+        {
+            int largest = -1;
+            float largest_area = -1.f;
+            for (int k = 0; k < leaf_count; ++k)
+            {
+                if (isLeaf(treelet_leaves[k]))
+                    continue;
+
+                float area = node_boxes[treelet_leaves[k]].area();
+                if (area > largest_area)
+                {
+                    largest = k;
+                    largest_area = area;
+                }
+            }
+            if (largest < 0)
+                break;
+
+            uint32_t opened = treelet_leaves[largest];
+            treelet_nodes[node_count++] = opened;
+            treelet_leaves[largest] = left[opened];
+            treelet_leaves[leaf_count++] = right[opened];
+        }
+
+        if (leaf_count < 3)
+            return;
+
+        // dynamic programming over all subsets of treelet leaves, a proper subset of a set
+        // always has a smaller bit mask so ascending order visits partitions before their union
+        const int subsets = 1 << leaf_count;
+        AABB subset_boxes[1 << TREELET_SIZE];
+        float subset_costs[1 << TREELET_SIZE];
+        uint32_t subset_counts[1 << TREELET_SIZE];
+        uint8_t subset_partitions[1 << TREELET_SIZE];
+
+        for (int s = 1; s < subsets; ++s)
+        {
+            int low = countTrailingZeros(s);
+            int rest = s & (s - 1);
+            if (rest == 0)
+            {
+                subset_boxes[s] = node_boxes[treelet_leaves[low]];
+                subset_counts[s] = node_counts[treelet_leaves[low]];
+                subset_costs[s] = node_costs[treelet_leaves[low]];
+                continue;
+            }
+
+            subset_boxes[s] = AABB::getSurroundingBox(subset_boxes[rest], subset_boxes[1 << low]);
+            subset_counts[s] = subset_counts[rest] + subset_counts[1 << low];
+
+            // only partitions holding the lowest leaf, the mirrored ones cost the same
+            float best_cost = INF;
+            int best_partition = 0;
+            for (int p = (s - 1) & s; p; p = (p - 1) & s)
+            {
+                if (!(p & (1 << low)))
+                    continue;
+
+                float cost = subset_costs[p] + subset_costs[s ^ p];
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_partition = p;
+                }
+            }
+
+            float area = subset_boxes[s].area();
+            float cost = BVH_TRAVERSAL_COST * area + best_cost;
+            if (subset_counts[s] <= BVH_LEAF_SIZE)
+                cost = fmin(cost, BVH_INTERSECT_COST * area * subset_counts[s]);
+            subset_costs[s] = cost;
+            subset_partitions[s] = static_cast<uint8_t>(best_partition);
+        }
+
+        if (subset_costs[subsets - 1] >= node_costs[root] * 0.999f)
+            return;
+
+        // rebuild the treelet topology in place, reusing its internal nodes with the root first
+        int next_node = 0;
+        auto rebuild = [&](auto &self, int s) -> uint32_t
+        {
+            if ((s & (s - 1)) == 0)
+                return treelet_leaves[countTrailingZeros(s)];
+
+            uint32_t node = treelet_nodes[next_node++];
+            int p = subset_partitions[s];
+            left[node] = self(self, p);
+            right[node] = self(self, s ^ p);
+            node_boxes[node] = subset_boxes[s];
+            node_counts[node] = subset_counts[s];
+            node_costs[node] = subset_costs[s];
+            return node;
+        };
+        rebuild(rebuild, subsets - 1);
+    }
+
+    uint32_t LBVHBuilder::emitNode(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, uint32_t node, int depth)
+    {
+        // the radix tree can be as deep as the code has bits and restructuring adds to that, below the limit the
+        // primitives are split at the median of their curve order instead
+        if (depth >= BVH_MAX_DEPTH && !isLeaf(node))
+        {
+            vector<uint32_t> prims;
+            gatherPrims(prims, node);
+            return emitMedian(nodes, prim_indices, prims, 0, static_cast<uint32_t>(prims.size()));
+        }
+
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({node_boxes[node], static_cast<uint32_t>(prim_indices.size()), 0, 0});
+
+        if (!isLeaf(node))
+        {
+            uint32_t l = left[node];
+            uint32_t r = right[node];
+
+            // collapse small subtrees whose primitives are cheaper to test directly
+            float area = node_boxes[node].area();
+            float split_cost = BVH_TRAVERSAL_COST * area + node_costs[l] + node_costs[r];
+            bool collapse = node_counts[node] <= BVH_LEAF_SIZE && BVH_INTERSECT_COST * area * node_counts[node] <= split_cost;
+
+            if (!collapse)
+            {
+                vec3 d = node_boxes[r].center() - node_boxes[l].center();
+                int axis = (fabs(d.x) > fabs(d.y) && fabs(d.x) > fabs(d.z)) ? 0 : (fabs(d.y) > fabs(d.z) ? 1 : 2);
+                if (d[axis] < 0)
+                    std::swap(l, r);
+
+                emitNode(nodes, prim_indices, l, depth + 1);
+                uint32_t right_index = emitNode(nodes, prim_indices, r, depth + 1);
+
+                nodes[index].offset = right_index;
+                nodes[index].axis = static_cast<uint16_t>(axis);
+                return index;
+            }
+        }
+
+        gatherPrims(prim_indices, node);
+        nodes[index].count = static_cast<uint16_t>(prim_indices.size() - nodes[index].offset);
+        return index;
+    }
+
+    uint32_t LBVHBuilder::emitMedian(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, const vector<uint32_t> &prims,
+                                     uint32_t begin, uint32_t end)
+    {
+        auto get_box = [&](uint32_t first, uint32_t last)
+        {
+            AABB box = AABB::empty();
+            for (uint32_t i = first; i < last; ++i)
+                box.expand(bounds[prims[i]]);
+            return box;
+        };
+
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({get_box(begin, end), static_cast<uint32_t>(prim_indices.size()), 0, 0});
+
+        uint32_t count = end - begin;
+        if (count <= BVH_LEAF_SIZE)
+        {
+            prim_indices.insert(prim_indices.end(), prims.begin() + begin, prims.begin() + end);
+            nodes[index].count = static_cast<uint16_t>(count);
+            return index;
+        }
+
+        uint32_t mid = begin + count / 2;
+        vec3 d = get_box(mid, end).center() - get_box(begin, mid).center();
+        int axis = (fabs(d.x) > fabs(d.y) && fabs(d.x) > fabs(d.z)) ? 0 : (fabs(d.y) > fabs(d.z) ? 1 : 2);
+
+        // the half further along the axis goes right, like in emitNode
+        bool swap = d[axis] < 0;
+        emitMedian(nodes, prim_indices, prims, swap ? mid : begin, swap ? end : mid);
+        uint32_t right_index = emitMedian(nodes, prim_indices, prims, swap ? begin : mid, swap ? mid : end);
+
+        nodes[index].offset = right_index;
+        nodes[index].axis = static_cast<uint16_t>(axis);
+        return index;
+    }
+
+    void LBVHBuilder::gatherPrims(vector<uint32_t> &prim_indices, uint32_t node)
+    {
+        if (isLeaf(node))
+        {
+            prim_indices.push_back(sorted_prims[node - (prim_count - 1)]);
+            return;
+        }
+
+        gatherPrims(prim_indices, left[node]);
+        gatherPrims(prim_indices, right[node]);
+    }
+}
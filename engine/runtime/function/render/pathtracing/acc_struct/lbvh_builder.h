@@ -0,0 +1,51 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Linear BVH (Karras 2012): primitives are sorted along a morton curve of their centroids and the
+    // hierarchy falls out of the sorted keys in linear time. An optional treelet restructuring pass
+    // (Karras and Aila 2013) recovers most of the SAH quality lost by the spatial median splits.
+    class LBVHBuilder
+    {
+    public:
+        LBVHBuilder(const vector<AABB> &prim_bounds);
+
+        void build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, bool restructure);
+
+    private:
+        static const int TREELET_SIZE = 7;
+        static const int RESTRUCTURE_PASSES = 3;
+
+        const vector<AABB> &bounds;
+        uint32_t prim_count;
+        int code_bits;
+
+        // morton codes in curve order and the primitive each of them belongs to
+        vector<uint64_t> codes;
+        vector<uint32_t> sorted_prims;
+
+        // binary radix tree, internal nodes are [0, n - 1) and leaf i is referenced as n - 1 + i
+        vector<uint32_t> left;
+        vector<uint32_t> right;
+        vector<AABB> node_boxes;
+        vector<uint32_t> node_counts;
+        vector<float> node_costs;
+
+        void computeMortonCodes();
+        void sortMortonCodes();
+        void buildHierarchy();
+        void updateNode(uint32_t node);
+        void computeBounds(uint32_t node, int depth);
+        void optimizeTreelets(uint32_t node, uint32_t gamma, int depth);
+        void restructureTreelet(uint32_t root);
+        uint32_t emitNode(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, uint32_t node, int depth);
+        uint32_t emitMedian(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, const vector<uint32_t> &prims,
+                            uint32_t begin, uint32_t end);
+        void gatherPrims(vector<uint32_t> &prim_indices, uint32_t node);
+
+        int delta(int i, int j) const;
+        bool isLeaf(uint32_t node) const { return node >= prim_count - 1; }
+    };
+}
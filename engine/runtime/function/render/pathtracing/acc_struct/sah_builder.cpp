@@ -0,0 +1,146 @@
+#include "runtime/function/render/pathtracing/acc_struct/sah_builder.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    SAHBuilder::SAHBuilder(const vector<AABB> &prim_bounds) : bounds(prim_bounds)
+    {
+        centroids.resize(bounds.size());
+        indices.resize(bounds.size());
+        for (uint32_t i = 0; i < bounds.size(); ++i)
+        {
+            centroids[i] = bounds[i].center();
+            indices[i] = i;
+        }
+    }
+
+    void SAHBuilder::build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices)
+    {
+        nodes.clear();
+        if (indices.empty())
+        {
+            prim_indices.clear();
+            return;
+        }
+
+        nodes.reserve(2 * indices.size());
+        buildNode(nodes, 0, static_cast<uint32_t>(indices.size()), 0);
+        prim_indices = std::move(indices);
+    }
+
+    uint32_t SAHBuilder::buildNode(vector<BVHNode> &nodes, uint32_t begin, uint32_t end, int depth)
+    {
+        AABB box = AABB::empty();
+        AABB centroid_box = AABB::empty();
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            box.expand(bounds[indices[i]]);
+            centroid_box.expand(centroids[indices[i]]);
+        }
+
+        uint32_t count = end - begin;
+        uint32_t node_index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({box, begin, static_cast<uint16_t>(count), 0});
+
+        if (count == 1)
+            return node_index;
+
+        // evaluate the binned SAH on every axis, costs are relative to the area of this node
+        int best_axis = -1;
+        int best_split = 0;
+        float best_cost = INF;
+        float leaf_cost = BVH_INTERSECT_COST * count;
+        float inv_area = 1.f / fmax(box.area(), 1e-20f);
+        vec3 extent = centroid_box.max - centroid_box.min;
+
+        if (depth < BVH_MAX_DEPTH)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (extent[axis] <= 0)
+                    continue;
+
+                AABB bin_boxes[BINS];
+                uint32_t bin_counts[BINS] = {0};
+                for (int b = 0; b < BINS; ++b)
+                    bin_boxes[b] = AABB::empty();
+
+                float scale = BINS / extent[axis];
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    uint32_t prim = indices[i];
+                    int b = std::min(BINS - 1, static_cast<int>((centroids[prim][axis] - centroid_box.min[axis]) * scale));
+                    bin_boxes[b].expand(bounds[prim]);
+                    bin_counts[b]++;
+                }
+
+                // sweep from the right to collect the cost of every right hand side
+                float right_cost[BINS];
+                AABB right_box = AABB::empty();
+                uint32_t right_count = 0;
+                for (int b = BINS - 1; b > 0; --b)
+                {
+                    right_box.expand(bin_boxes[b]);
+                    right_count += bin_counts[b];
+                    right_cost[b] = right_box.area() * right_count;
+                }
+
+                AABB left_box = AABB::empty();
+                uint32_t left_count = 0;
+                for (int b = 0; b < BINS - 1; ++b)
+                {
+                    left_box.expand(bin_boxes[b]);
+                    left_count += bin_counts[b];
+                    if (left_count == 0 || left_count == count)
+                        continue;
+
+                    float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * (left_box.area() * left_count + right_cost[b + 1]) * inv_area;
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = b + 1;
+                    }
+                }
+            }
+        }
+
+        if (count <= BVH_LEAF_SIZE && (best_axis < 0 || best_cost >= leaf_cost))
+            return node_index;
+
+        uint32_t mid;
+        int axis;
+        if (best_axis >= 0)
+        {
+            axis = best_axis;
+            float scale = BINS / extent[axis];
+            float min_bound = centroid_box.min[axis];
+            mid = static_cast<uint32_t>(std::partition(indices.begin() + begin, indices.begin() + end,
+                                                       [&](uint32_t prim)
+                                                       {
+                                                           int b = std::min(BINS - 1, static_cast<int>((centroids[prim][axis] - min_bound) * scale));
+                                                           return b < best_split;
+                                                       }) -
+                                        indices.begin());
+        }
+        else
+        {
+            // coincident centroids or the depth limit, fall back to an object median split
+            axis = centroid_box.maxExtent();
+            mid = begin + count / 2;
+            std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                             [&](uint32_t a, uint32_t b)
+                             { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        buildNode(nodes, begin, mid, depth + 1);
+        uint32_t right = buildNode(nodes, mid, end, depth + 1);
+
+        nodes[node_index].offset = right;
+        nodes[node_index].count = 0;
+        nodes[node_index].axis = static_cast<uint16_t>(axis);
+
+        return node_index;
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Top down builder, every node is split at the cheapest of BINS candidate planes per axis
+    class SAHBuilder
+    {
+    public:
+        SAHBuilder(const vector<AABB> &prim_bounds);
+
+        void build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices);
+
+    private:
+        static const int BINS = 16;
+
+        const vector<AABB> &bounds;
+        vector<vec3> centroids;
+        vector<uint32_t> indices;
+
+        uint32_t buildNode(vector<BVHNode> &nodes, uint32_t begin, uint32_t end, int depth);
+    };
+}
@@ -0,0 +1,349 @@
+#include "runtime/function/render/pathtracing/acc_struct/sbvh_builder.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    SBVHBuilder::SBVHBuilder(SplitFunc split_prim, const vector<AABB> &prim_bounds, float split_budget)
+        : split(std::move(split_prim)), bounds(prim_bounds)
+    {
+        reference_count = bounds.size();
+        reference_limit = bounds.size() + static_cast<size_t>(bounds.size() * fmax(split_budget, 0.f));
+        min_overlap = 0.f;
+    }
+
+    void SBVHBuilder::build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices)
+    {
+        nodes.clear();
+        prim_indices.clear();
+        if (bounds.empty())
+            return;
+
+        vector<Reference> refs(bounds.size());
+        AABB root_box = AABB::empty();
+        for (uint32_t i = 0; i < bounds.size(); ++i)
+        {
+            refs[i] = {bounds[i], i};
+            root_box.expand(bounds[i]);
+        }
+        min_overlap = MIN_OVERLAP * root_box.area();
+
+        nodes.reserve(2 * reference_limit);
+        prim_indices.reserve(reference_limit);
+        buildNode(nodes, prim_indices, refs, 0);
+    }
+
+    uint32_t SBVHBuilder::buildNode(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, vector<Reference> &refs, int depth)
+    {
+        AABB box = AABB::empty();
+        AABB centroid_box = AABB::empty();
+        for (const auto &ref : refs)
+        {
+            box.expand(ref.box);
+            centroid_box.expand(ref.box.center());
+        }
+
+        uint32_t count = static_cast<uint32_t>(refs.size());
+        uint32_t node_index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({box, static_cast<uint32_t>(prim_indices.size()), static_cast<uint16_t>(count), 0});
+
+        float leaf_cost = BVH_INTERSECT_COST * count;
+        float inv_area = 1.f / fmax(box.area(), 1e-20f);
+
+        Split split;
+        if (count > 1 && depth < BVH_MAX_DEPTH)
+        {
+            split = findObjectSplit(refs, centroid_box, inv_area);
+
+            // a spatial split only pays off where the object split leaves the children overlapping
+            AABB overlap = split.left_box;
+            overlap.intersect(split.right_box);
+            bool overlapping = split.axis < 0 || (!overlap.isEmpty() && overlap.area() > min_overlap);
+
+            if (overlapping && reference_count < reference_limit)
+            {
+                Split spatial = findSpatialSplit(refs, box, inv_area);
+                if (spatial.cost < split.cost && reference_count + spatial.left_count + spatial.right_count - count <= reference_limit)
+                    split = spatial;
+            }
+        }
+
+        if (count == 1 || (count <= BVH_LEAF_SIZE && (split.axis < 0 || split.cost >= leaf_cost)))
+        {
+            for (const auto &ref : refs)
+                prim_indices.push_back(ref.prim);
+            return node_index;
+        }
+
+        vector<Reference> left;
+        vector<Reference> right;
+        int axis = split.axis;
+        if (split.spatial)
+            performSpatialSplit(refs, box, split, left, right);
+        else if (split.axis >= 0)
+            performObjectSplit(refs, centroid_box, split, left, right);
+
+        if (left.empty() || right.empty())
+        {
+            // coincident centroids, the depth limit or a degenerate split, fall back to an object median split
+            axis = centroid_box.maxExtent();
+            uint32_t mid = count / 2;
+            std::nth_element(refs.begin(), refs.begin() + mid, refs.end(),
+                             [&](const Reference &a, const Reference &b)
+                             { return a.box.center()[axis] < b.box.center()[axis]; });
+            left.assign(refs.begin(), refs.begin() + mid);
+            right.assign(refs.begin() + mid, refs.end());
+        }
+        else if (split.spatial)
+        {
+            reference_count += left.size() + right.size() - count;
+        }
+
+        // release this level before descending, only the pending right halves stay alive
+        vector<Reference>().swap(refs);
+
+        buildNode(nodes, prim_indices, left, depth + 1);
+        vector<Reference>().swap(left);
+        uint32_t right_index = buildNode(nodes, prim_indices, right, depth + 1);
+
+        nodes[node_index].offset = right_index;
+        nodes[node_index].count = 0;
+        nodes[node_index].axis = static_cast<uint16_t>(axis);
+
+        return node_index;
+    }
+
+    SBVHBuilder::Split SBVHBuilder::findObjectSplit(const vector<Reference> &refs, const AABB &centroid_box, float inv_area) const
+    {
+        Split best;
+        vec3 extent = centroid_box.max - centroid_box.min;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0)
+                continue;
+
+            AABB bin_boxes[OBJECT_BINS];
+            uint32_t bin_counts[OBJECT_BINS] = {0};
+            for (int b = 0; b < OBJECT_BINS; ++b)
+                bin_boxes[b] = AABB::empty();
+
+            float scale = OBJECT_BINS / extent[axis];
+            for (const auto &ref : refs)
+            {
+                int b = std::min(OBJECT_BINS - 1, static_cast<int>((ref.box.center()[axis] - centroid_box.min[axis]) * scale));
+                bin_boxes[b].expand(ref.box);
+                bin_counts[b]++;
+            }
+
+            // sweep from the right to collect every right hand side
+            AABB right_boxes[OBJECT_BINS];
+            uint32_t right_counts[OBJECT_BINS];
+            AABB right_box = AABB::empty();
+            uint32_t right_count = 0;
+            for (int b = OBJECT_BINS - 1; b > 0; --b)
+            {
+                right_box.expand(bin_boxes[b]);
+                right_count += bin_counts[b];
+                right_boxes[b] = right_box;
+                right_counts[b] = right_count;
+            }
+
+            AABB left_box = AABB::empty();
+            uint32_t left_count = 0;
+            for (int b = 0; b < OBJECT_BINS - 1; ++b)
+            {
+                left_box.expand(bin_boxes[b]);
+                left_count += bin_counts[b];
+                if (left_count == 0 || right_counts[b + 1] == 0)
+                    continue;
+
+                float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * (left_box.area() * left_count + right_boxes[b + 1].area() * right_counts[b + 1]) * inv_area;
+                if (cost < best.cost)
+                {
+                    best.cost = cost;
+                    best.axis = axis;
+                    best.bin = b + 1;
+                    best.left_box = left_box;
+                    best.right_box = right_boxes[b + 1];
+                    best.left_count = left_count;
+                    best.right_count = right_counts[b + 1];
+                }
+            }
+        }
+
+        return best;
+    }
+
+    SBVHBuilder::Split SBVHBuilder::findSpatialSplit(const vector<Reference> &refs, const AABB &box, float inv_area) const
+    {
+        Split best;
+        best.spatial = true;
+        vec3 extent = box.max - box.min;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0)
+                continue;
+
+            AABB bin_boxes[SPATIAL_BINS];
+            uint32_t entry_counts[SPATIAL_BINS] = {0};
+            uint32_t exit_counts[SPATIAL_BINS] = {0};
+            for (int b = 0; b < SPATIAL_BINS; ++b)
+                bin_boxes[b] = AABB::empty();
+
+            // chop every reference into the bins it spans, it enters the first one and exits the last one
+            float bin_size = extent[axis] / SPATIAL_BINS;
+            float scale = 1.f / bin_size;
+            for (const auto &ref : refs)
+            {
+                int first = std::clamp(static_cast<int>((ref.box.min[axis] - box.min[axis]) * scale), 0, SPATIAL_BINS - 1);
+                int last = std::clamp(static_cast<int>((ref.box.max[axis] - box.min[axis]) * scale), first, SPATIAL_BINS - 1);
+
+                Reference rest = ref;
+                for (int b = first; b < last; ++b)
+                {
+                    Reference left_part, right_part;
+                    splitReference(rest, axis, box.min[axis] + bin_size * (b + 1), left_part, right_part);
+                    bin_boxes[b].expand(left_part.box);
+                    rest = right_part;
+                }
+                bin_boxes[last].expand(rest.box);
+                entry_counts[first]++;
+                exit_counts[last]++;
+            }
+
+            AABB right_boxes[SPATIAL_BINS];
+            uint32_t right_counts[SPATIAL_BINS];
+            AABB right_box = AABB::empty();
+            uint32_t right_count = 0;
+            for (int b = SPATIAL_BINS - 1; b > 0; --b)
+            {
+                right_box.expand(bin_boxes[b]);
+                right_count += exit_counts[b];
+                right_boxes[b] = right_box;
+                right_counts[b] = right_count;
+            }
+
+            AABB left_box = AABB::empty();
+            uint32_t left_count = 0;
+            for (int b = 0; b < SPATIAL_BINS - 1; ++b)
+            {
+                left_box.expand(bin_boxes[b]);
+                left_count += entry_counts[b];
+                if (left_count == 0 || right_counts[b + 1] == 0)
+                    continue;
+
+                float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * (left_box.area() * left_count + right_boxes[b + 1].area() * right_counts[b + 1]) * inv_area;
+                if (cost < best.cost)
+                {
+                    best.cost = cost;
+                    best.axis = axis;
+                    best.bin = b + 1;
+                    best.left_box = left_box;
+                    best.right_box = right_boxes[b + 1];
+                    best.left_count = left_count;
+                    best.right_count = right_counts[b + 1];
+                }
+            }
+        }
+
+        return best;
+    }
+
+    void SBVHBuilder::performObjectSplit(vector<Reference> &refs, const AABB &centroid_box, const Split &split,
+                                         vector<Reference> &left, vector<Reference> &right) const
+    {
+        float min_bound = centroid_box.min[split.axis];
+        float scale = OBJECT_BINS / (centroid_box.max[split.axis] - min_bound);
+
+        left.reserve(split.left_count);
+        right.reserve(split.right_count);
+        for (const auto &ref : refs)
+        {
+            int b = std::min(OBJECT_BINS - 1, static_cast<int>((ref.box.center()[split.axis] - min_bound) * scale));
+            (b < split.bin ? left : right).push_back(ref);
+        }
+    }
+
+    void SBVHBuilder::performSpatialSplit(vector<Reference> &refs, const AABB &box, const Split &split,
+                                          vector<Reference> &left, vector<Reference> &right) const
+    {
+        int axis = split.axis;
+        float position = box.min[axis] + (box.max[axis] - box.min[axis]) * split.bin / SPATIAL_BINS;
+
+        // references entirely on one side go there, the ones straddling the plane are decided below
+        AABB left_box = AABB::empty();
+        AABB right_box = AABB::empty();
+        vector<Reference> straddling;
+        left.reserve(split.left_count);
+        right.reserve(split.right_count);
+        for (const auto &ref : refs)
+        {
+            if (ref.box.max[axis] <= position)
+            {
+                left.push_back(ref);
+                left_box.expand(ref.box);
+            }
+            else if (ref.box.min[axis] >= position)
+            {
+                right.push_back(ref);
+                right_box.expand(ref.box);
+            }
+            else
+            {
+                straddling.push_back(ref);
+            }
+        }
+
+        // reference unsplitting: keep a straddling reference whole on one side when that is cheaper than duplicating it
+        float left_count = static_cast<float>(left.size() + straddling.size());
+        float right_count = static_cast<float>(right.size() + straddling.size());
+        for (const auto &ref : straddling)
+        {
+            Reference left_part, right_part;
+            splitReference(ref, axis, position, left_part, right_part);
+
+            AABB left_union = AABB::getSurroundingBox(left_box, ref.box);
+            AABB right_union = AABB::getSurroundingBox(right_box, ref.box);
+            AABB left_split = left_box;
+            AABB right_split = right_box;
+            left_split.expand(left_part.box);
+            right_split.expand(right_part.box);
+
+            float left_cost = left_union.area() * left_count + right_box.area() * (right_count - 1);
+            float right_cost = left_box.area() * (left_count - 1) + right_union.area() * right_count;
+            float split_cost = left_split.area() * left_count + right_split.area() * right_count;
+
+            bool left_only = right_part.box.isEmpty() || (!left_part.box.isEmpty() && left_cost < split_cost && left_cost <= right_cost);
+            bool right_only = !left_only && (left_part.box.isEmpty() || right_cost < split_cost);
+
+            if (left_only)
+            {
+                left.push_back(ref);
+                left_box = left_union;
+                right_count -= 1;
+            }
+            else if (right_only)
+            {
+                right.push_back(ref);
+                right_box = right_union;
+                left_count -= 1;
+            }
+            else
+            {
+                left.push_back(left_part);
+                right.push_back(right_part);
+                left_box = left_split;
+                right_box = right_split;
+            }
+        }
+    }
+
+    void SBVHBuilder::splitReference(const Reference &ref, int axis, float position, Reference &left, Reference &right) const
+    {
+        left.prim = ref.prim;
+        right.prim = ref.prim;
+        split(ref.prim, axis, position, ref.box, left.box, right.box);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+
+#include <functional>
+
+namespace MiniEngine::PathTracing
+{
+    // Spatial split BVH (Stich et al. 2009). Next to the binned object split every node also tries splitting space
+    // at a plane, primitives crossing it are clipped and referenced from both children. Long thin triangles stop
+    // dragging large overlapping boxes through the tree, at the price of duplicate references capped by a budget.
+    class SBVHBuilder
+    {
+    public:
+        // bounds of the parts of primitive prim on either side of a plane, restricted to box
+        typedef std::function<void(uint32_t prim, int axis, float position, const AABB &box, AABB &left, AABB &right)> SplitFunc;
+
+        SBVHBuilder(SplitFunc split_prim, const vector<AABB> &prim_bounds, float split_budget);
+
+        void build(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices);
+
+    private:
+        static const int OBJECT_BINS = 16;
+        static const int SPATIAL_BINS = 32;
+        // spatial splits are only tried where the object split children overlap by this fraction of the root area
+        static constexpr float MIN_OVERLAP = 1e-5f;
+
+        struct Reference
+        {
+            AABB box;
+            uint32_t prim;
+        };
+
+        struct Split
+        {
+            float cost{INF};
+            int axis{-1};
+            int bin{0};
+            bool spatial{false};
+            AABB left_box;
+            AABB right_box;
+            uint32_t left_count{0};
+            uint32_t right_count{0};
+        };
+
+        SplitFunc split;
+        const vector<AABB> &bounds;
+        size_t reference_limit;
+        size_t reference_count;
+        float min_overlap;
+
+        uint32_t buildNode(vector<BVHNode> &nodes, vector<uint32_t> &prim_indices, vector<Reference> &refs, int depth);
+        Split findObjectSplit(const vector<Reference> &refs, const AABB &centroid_box, float inv_area) const;
+        Split findSpatialSplit(const vector<Reference> &refs, const AABB &box, float inv_area) const;
+        void performObjectSplit(vector<Reference> &refs, const AABB &centroid_box, const Split &split, vector<Reference> &left, vector<Reference> &right) const;
+        void performSpatialSplit(vector<Reference> &refs, const AABB &box, const Split &split, vector<Reference> &left, vector<Reference> &right) const;
+        void splitReference(const Reference &ref, int axis, float position, Reference &left, Reference &right) const;
+    };
+}
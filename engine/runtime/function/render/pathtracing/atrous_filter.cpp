@@ -0,0 +1,202 @@
+#include "runtime/function/render/pathtracing/atrous_filter.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace MiniEngine::PathTracing
+{
+    // surfaces darker than this are filtered as if they had this albedo
+    static const float MIN_DEMODULATION = 1e-3f;
+
+    static float getLuminance(const vec3 &c)
+    {
+        return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    }
+
+    // The helpers below are arithmetic only, a compare or a call in the filter loops keeps them from vectorizing.
+
+    // max(x, 0)
+    static inline float positivePart(float x)
+    {
+        return 0.5f * (x + std::abs(x));
+    }
+
+    // e^x for x <= 0 to within 0.03%. Below e^-16 it stays at e^-16, next to the other taps that is no weight at all,
+    // while squares of smaller weights would reach denormals and slow the variance sums down many times.
+    static inline float fastExp(float x)
+    {
+        float t = (positivePart(x + 16.f) - 16.f) * 1.44269504f; // in powers of two
+        int whole = static_cast<int>(t);                         // rounds up, t is negative
+        float f = t - whole;                                     // in (-1, 0]
+        float p = 1.f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f + f * (0.00961813f + f * 0.00133336f))));
+        int32_t bits = (whole + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(float));
+        return p * scale;
+    }
+
+    void ATrousFilter::apply(const vec3 *color, const vec3 *albedo, const vec3 *normal, const float *depth, int width,
+                             int height, vec3 *output, int first_row)
+    {
+        first_row = glm::clamp(first_row, 0, height);
+        if (first_row == height)
+            return;
+
+        size_t count = static_cast<size_t>(width) * height;
+        for (int k = 0; k < 2; ++k)
+        {
+            irradiance[k].resize(count);
+            variance[k].resize(count);
+        }
+        luminance.resize(count);
+        demodulation.resize(count);
+        unit_normal.resize(count);
+        background.resize(count);
+        depth_gradient.resize(count);
+
+        // untextured lighting, the normal and the larger depth change to a horizontal or vertical neighbour
+        tbb::parallel_for(first_row, height, [&](int y)
+                          {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t p = static_cast<size_t>(y) * width + x;
+                demodulation[p] = glm::max(albedo[p], vec3(MIN_DEMODULATION));
+                irradiance[0][p] = color[p] / demodulation[p];
+                luminance[p] = getLuminance(irradiance[0][p]);
+
+                float length_squared = dot(normal[p], normal[p]);
+                unit_normal[p] = length_squared > 0 ? normal[p] / std::sqrt(length_squared) : vec3(0, 0, 0);
+                background[p] = length_squared > 0 ? 0.f : 1.f;
+
+                float gradient = 0;
+                if (x > 0)
+                    gradient = std::max(gradient, std::abs(depth[p] - depth[p - 1]));
+                if (x + 1 < width)
+                    gradient = std::max(gradient, std::abs(depth[p] - depth[p + 1]));
+                if (y > first_row)
+                    gradient = std::max(gradient, std::abs(depth[p] - depth[p - width]));
+                if (y + 1 < height)
+                    gradient = std::max(gradient, std::abs(depth[p] - depth[p + width]));
+                depth_gradient[p] = gradient;
+            } });
+
+        // the noise level from the 3 x 3 neighbourhood, a single frame has no history to take it from
+        tbb::parallel_for(first_row, height, [&](int y)
+                          {
+            for (int x = 0; x < width; ++x)
+            {
+                float sum = 0, sum_squares = 0;
+                int taps = 0;
+                for (int yy = std::max(y - 1, first_row); yy <= std::min(y + 1, height - 1); ++yy)
+                {
+                    for (int xx = std::max(x - 1, 0); xx <= std::min(x + 1, width - 1); ++xx)
+                    {
+                        float l = luminance[static_cast<size_t>(yy) * width + xx];
+                        sum += l;
+                        sum_squares += l * l;
+                        ++taps;
+                    }
+                }
+                float mean = sum / taps;
+                variance[0][static_cast<size_t>(y) * width + x] = std::max(sum_squares / taps - mean * mean, 0.f);
+            } });
+
+        int current = 0;
+        for (int i = 0; i < iterations; ++i)
+        {
+            iterate(depth, width, height, first_row, 1 << i, irradiance[current], variance[current],
+                    irradiance[1 - current], variance[1 - current]);
+            current = 1 - current;
+        }
+
+        tbb::parallel_for(first_row, height, [&](int y)
+                          {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t p = static_cast<size_t>(y) * width + x;
+                output[p] = irradiance[current][p] * demodulation[p];
+            } });
+    }
+
+    void ATrousFilter::iterate(const float *depth, int width, int height, int first_row, int step,
+                               const vector<vec3> &irradiance_in, const vector<float> &variance_in,
+                               vector<vec3> &irradiance_out, vector<float> &variance_out)
+    {
+        static const float kernel[5] = {1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16};
+
+        // a row at a time and one tap offset for the whole row, so the inner loops have no branches and vectorize
+        tbb::parallel_for(first_row, height, [&](int y)
+                          {
+            vector<float> depth_scale(width), luminance_scale(width), weights(width);
+            vector<vec4> sum(width, vec4(0, 0, 0, 0)); // weighted irradiance and the sum of weights
+            vector<float> sum_variance(width, 0.f);
+
+            const size_t row = static_cast<size_t>(y) * width;
+            const vec3 *n_p = unit_normal.data() + row;
+            const float *z_p = depth + row;
+            const float *l_p = luminance.data() + row;
+            const float *b_p = background.data() + row;
+            for (int x = 0; x < width; ++x)
+            {
+                depth_scale[x] = 1.f / (sigma_depth * depth_gradient[row + x] * step + 1e-4f);
+                luminance_scale[x] = 1.f / (sigma_luminance * std::sqrt(variance_in[row + x]) + 1e-4f);
+            }
+
+            for (int dy = -2; dy <= 2; ++dy)
+            {
+                int yy = y + dy * step;
+                if (yy < first_row || yy >= height)
+                    continue;
+
+                for (int dx = -2; dx <= 2; ++dx)
+                {
+                    const int offset = dx * step;
+                    const int begin = std::max(0, -offset), end = std::min(width, width - offset);
+                    const float k = kernel[dx + 2] * kernel[dy + 2];
+                    const float distance = std::max(std::sqrt(float(dx * dx + dy * dy)), 1.f);
+                    const size_t row_q = static_cast<size_t>(yy) * width + offset;
+                    const vec3 *n_q = unit_normal.data() + row_q;
+                    const float *z_q = depth + row_q;
+                    const float *l_q = luminance.data() + row_q;
+                    const float *b_q = background.data() + row_q;
+
+                    // the weights only read, so the compiler does not have to rule out that they overlap the sums
+                    float *w = weights.data();
+                    for (int x = begin; x < end; ++x)
+                    {
+                        // surfaces only mix where they face the same way, background only with background.
+                        // exp(128 (cos - 1)) is close to cos^128 and folds into the single exp.
+                        float normal_term = 1.f - dot(n_p[x], n_q[x]) - b_p[x] * b_q[x];
+                        w[x] = k * fastExp(-sigma_normal * normal_term -
+                                           std::abs(z_p[x] - z_q[x]) * depth_scale[x] / distance -
+                                           std::abs(l_p[x] - l_q[x]) * luminance_scale[x]);
+                    }
+
+                    const vec3 *c_q = irradiance_in.data() + row_q;
+                    const float *v_q = variance_in.data() + row_q;
+                    for (int x = begin; x < end; ++x)
+                    {
+                        sum[x] += w[x] * vec4(c_q[x], 1.f);
+                        sum_variance[x] += w[x] * w[x] * v_q[x];
+                    }
+                }
+            }
+
+            // the center tap always counts, so the weights never sum to zero
+            for (int x = 0; x < width; ++x)
+            {
+                irradiance_out[row + x] = vec3(sum[x]) / sum[x].w;
+                variance_out[row + x] = sum_variance[x] / (sum[x].w * sum[x].w);
+            } });
+
+        // luminance of the next iteration's input, read by every tap
+        tbb::parallel_for(first_row, height, [&](int y)
+                          {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t p = static_cast<size_t>(y) * width + x;
+                luminance[p] = getLuminance(irradiance_out[p]);
+            } });
+    }
+}
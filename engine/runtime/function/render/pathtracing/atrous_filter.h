@@ -0,0 +1,38 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Edge-aware à-trous wavelet filter in the style of SVGF, fast enough to clean up every preview of a render at a
+    // few samples per pixel. The color is divided by the albedo so texture detail survives, then blurred with a
+    // 5 x 5 B3 spline kernel whose taps spread twice as far with every iteration. Taps are weighted down across
+    // changes in normal and depth and across luminance differences larger than the local noise, whose variance is
+    // estimated spatially and filtered along with the color.
+    class ATrousFilter
+    {
+    public:
+        int iterations{5};
+        float sigma_normal{128.f};  // falloff with the angle between normals, like a power of their cosine
+        float sigma_depth{1.f};     // allowed depth change in units of the local depth gradient
+        float sigma_luminance{4.f}; // allowed luminance change in standard deviations of the noise
+
+        // Filters rows first_row and up of images laid out like the path tracer's buffers, rows below first_row
+        // are neither read nor written. The scratch buffers are kept, so only one thread may use a filter.
+        void apply(const vec3 *color, const vec3 *albedo, const vec3 *normal, const float *depth, int width, int height,
+                   vec3 *output, int first_row = 0);
+
+    private:
+        vector<vec3> irradiance[2];
+        vector<float> variance[2];
+        vector<float> luminance;
+        vector<vec3> demodulation;
+        vector<vec3> unit_normal; // zero where the path escaped
+        vector<float> background; // 1 where the path escaped, 0 on surfaces
+        vector<float> depth_gradient;
+
+        void iterate(const float *depth, int width, int height, int first_row, int step,
+                     const vector<vec3> &irradiance_in, const vector<float> &variance_in,
+                     vector<vec3> &irradiance_out, vector<float> &variance_out);
+    };
+}
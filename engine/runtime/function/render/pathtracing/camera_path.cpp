@@ -0,0 +1,130 @@
+#include "runtime/function/render/pathtracing/camera_path.h"
+#include "runtime/core/meta/json.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace MiniEngine::PathTracing
+{
+    void CameraPath::addKeyframe(const CameraKeyframe &keyframe)
+    {
+        auto it = std::lower_bound(keyframes.begin(), keyframes.end(), keyframe.time,
+                                   [](const CameraKeyframe &k, float time)
+                                   { return k.time < time; });
+        if (it != keyframes.end() && it->time == keyframe.time)
+            *it = keyframe;
+        else
+            keyframes.insert(it, keyframe);
+    }
+
+    // cubic Hermite between p1 at t1 and p2 at t2, with Catmull-Rom tangents from the neighbours p0 and p3
+    template <typename T>
+    static T hermite(const T &p0, const T &p1, const T &p2, const T &p3, float t0, float t1, float t2, float t3, float t)
+    {
+        float span = t2 - t1;
+        T m1 = (p2 - p0) * (span / std::max(t2 - t0, 1e-6f));
+        T m2 = (p3 - p1) * (span / std::max(t3 - t1, 1e-6f));
+        float s = (t - t1) / span, s2 = s * s, s3 = s2 * s;
+        return p1 * (2 * s3 - 3 * s2 + 1) + m1 * (s3 - 2 * s2 + s) + p2 * (-2 * s3 + 3 * s2) + m2 * (s3 - s2);
+    }
+
+    CameraKeyframe CameraPath::evaluate(float time) const
+    {
+        if (keyframes.empty())
+            return CameraKeyframe();
+        if (time <= keyframes.front().time)
+            return keyframes.front();
+        if (time >= keyframes.back().time)
+            return keyframes.back();
+
+        // the segment from keyframe i to i + 1, the ends stand in for their missing neighbours
+        size_t i = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+                                    [](float time, const CameraKeyframe &k)
+                                    { return time < k.time; }) -
+                   keyframes.begin() - 1;
+        const CameraKeyframe &k0 = keyframes[i > 0 ? i - 1 : i];
+        const CameraKeyframe &k1 = keyframes[i];
+        const CameraKeyframe &k2 = keyframes[i + 1];
+        const CameraKeyframe &k3 = keyframes[std::min(i + 2, keyframes.size() - 1)];
+
+        CameraKeyframe result;
+        result.time = time;
+        result.position = hermite(k0.position, k1.position, k2.position, k3.position, k0.time, k1.time, k2.time, k3.time, time);
+        result.yaw = hermite(k0.yaw, k1.yaw, k2.yaw, k3.yaw, k0.time, k1.time, k2.time, k3.time, time);
+        result.pitch = hermite(k0.pitch, k1.pitch, k2.pitch, k3.pitch, k0.time, k1.time, k2.time, k3.time, time);
+
+        float s = (time - k1.time) / (k2.time - k1.time);
+        result.fov = glm::mix(k1.fov, k2.fov, s);
+        result.aperture = glm::mix(k1.aperture, k2.aperture, s);
+        result.focus_distance = glm::mix(k1.focus_distance, k2.focus_distance, s);
+        return result;
+    }
+
+    bool CameraPath::load(const std::filesystem::path &file)
+    {
+        std::ifstream in(file);
+        if (!in)
+        {
+            std::cerr << "Failed to open camera path " << file << std::endl;
+            return false;
+        }
+        std::stringstream text;
+        text << in.rdbuf();
+
+        std::string error;
+        Json json = Json::parse(text.str(), error);
+        if (!error.empty() || !json["keyframes"].is_array())
+        {
+            std::cerr << "Invalid camera path " << file << ": " << error << std::endl;
+            return false;
+        }
+
+        keyframes.clear();
+        for (const Json &item : json["keyframes"].array_items())
+        {
+            CameraKeyframe keyframe;
+            keyframe.time = static_cast<float>(item["time"].number_value());
+            const auto &position = item["position"].array_items();
+            for (int k = 0; k < 3 && k < static_cast<int>(position.size()); ++k)
+                keyframe.position[k] = static_cast<float>(position[k].number_value());
+            if (item["yaw"].is_number())
+                keyframe.yaw = static_cast<float>(item["yaw"].number_value());
+            if (item["pitch"].is_number())
+                keyframe.pitch = static_cast<float>(item["pitch"].number_value());
+            if (item["fov"].is_number())
+                keyframe.fov = static_cast<float>(item["fov"].number_value());
+            if (item["aperture"].is_number())
+                keyframe.aperture = static_cast<float>(item["aperture"].number_value());
+            if (item["focus_distance"].is_number())
+                keyframe.focus_distance = static_cast<float>(item["focus_distance"].number_value());
+            addKeyframe(keyframe);
+        }
+        return true;
+    }
+
+    bool CameraPath::save(const std::filesystem::path &file) const
+    {
+        Json::array items;
+        for (const auto &keyframe : keyframes)
+        {
+            items.push_back(Json::object{
+                {"time", keyframe.time},
+                {"position", Json::array{keyframe.position.x, keyframe.position.y, keyframe.position.z}},
+                {"yaw", keyframe.yaw},
+                {"pitch", keyframe.pitch},
+                {"fov", keyframe.fov},
+                {"aperture", keyframe.aperture},
+                {"focus_distance", keyframe.focus_distance}});
+        }
+
+        std::ofstream out(file);
+        out << Json(Json::object{{"keyframes", items}}).dump();
+        if (!out)
+        {
+            std::cerr << "Failed to write camera path " << file << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
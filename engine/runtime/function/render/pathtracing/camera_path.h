@@ -0,0 +1,42 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <filesystem>
+
+namespace MiniEngine::PathTracing
+{
+    // The camera settings a sequence passes through at one moment, angles in degrees as the editor camera has them
+    struct CameraKeyframe
+    {
+        float time{0.f}; // seconds from the start of the sequence
+        vec3 position{0, 0, 0};
+        float yaw{-90.f};
+        float pitch{0.f};
+        float fov{45.f};
+        float aperture{0.f};
+        float focus_distance{10.f}; // only used with the camera in manual focus, autofocus measures every frame
+    };
+
+    // Keyframes of a camera fly-through, kept in time order. Position and angles follow a cubic through the
+    // keyframes, so the camera does not jerk at them, the lens settings change linearly. Angles are not wrapped,
+    // a yaw from 350 to 10 degrees turns the long way round, so keyframes can also spin the camera on purpose.
+    class CameraPath
+    {
+    public:
+        vector<CameraKeyframe> keyframes;
+
+        // keeps the order, a keyframe at the time of an existing one replaces it
+        void addKeyframe(const CameraKeyframe &keyframe);
+        void clear() { keyframes.clear(); }
+        bool empty() const { return keyframes.empty(); }
+        float getDuration() const { return keyframes.empty() ? 0.f : keyframes.back().time; }
+
+        // holds the first and last keyframe before and after the path
+        CameraKeyframe evaluate(float time) const;
+
+        // {"keyframes": [{"time", "position": [x, y, z], "yaw", "pitch", "fov", "aperture", "focus_distance"}, ...]}
+        bool load(const std::filesystem::path &file);
+        bool save(const std::filesystem::path &file) const;
+    };
+}
@@ -41,6 +41,22 @@ namespace MiniEngine::PathTracing
             return Ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset);
         }
 
+        // the same ray with differentials towards the points ds and dt further across the viewport, all of them
+        // through one point on the lens
+        Ray getRay(f32 s, f32 t, f32 ds, f32 dt) const
+        {
+            vec3 rd = lens_radius * vec3(diskRand(1.f), 0);
+            vec3 offset = u * rd.x + v * rd.y;
+            vec3 target = lower_left_corner + s * horizontal + t * vertical - origin - offset;
+
+            Ray r(origin + offset, target);
+            r.has_differentials = true;
+            r.rx_origin = r.ry_origin = r.origin;
+            r.rx_direction = normalize(target + ds * horizontal);
+            r.ry_direction = normalize(target + dt * vertical);
+            return r;
+        }
+
     private:
         vec3 origin;
         vec3 lower_left_corner;
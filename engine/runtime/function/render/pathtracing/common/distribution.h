@@ -0,0 +1,104 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    // Piecewise constant density over [0, 1) with n equal steps, sampled by inverting its cdf
+    class Distribution1D
+    {
+    public:
+        vector<float> func;
+        vector<float> cdf;
+        float integral;
+
+        Distribution1D() {}
+        Distribution1D(const float *f, int n);
+
+        int count() const { return static_cast<int>(func.size()); }
+
+        // position in [0, 1), its density and the step it fell into
+        float sample(float u, float &pdf, int &offset) const;
+    };
+
+    // Piecewise constant density over [0, 1)^2, a marginal over the rows and one conditional per row
+    class Distribution2D
+    {
+    public:
+        Distribution2D() {}
+        Distribution2D(const float *f, int nu, int nv);
+
+        vec2 sample(const vec2 &u, float &pdf) const;
+        float getPDF(const vec2 &p) const;
+
+    private:
+        vector<Distribution1D> conditional;
+        Distribution1D marginal;
+    };
+
+    inline Distribution1D::Distribution1D(const float *f, int n) : func(f, f + n), cdf(n + 1)
+    {
+        cdf[0] = 0;
+        for (int i = 1; i < n + 1; ++i)
+            cdf[i] = cdf[i - 1] + func[i - 1] / n;
+
+        // a function that is zero everywhere is sampled uniformly instead
+        integral = cdf[n];
+        if (integral == 0)
+        {
+            for (int i = 1; i < n + 1; ++i)
+                cdf[i] = float(i) / float(n);
+        }
+        else
+        {
+            for (int i = 1; i < n + 1; ++i)
+                cdf[i] /= integral;
+        }
+    }
+
+    inline float Distribution1D::sample(float u, float &pdf, int &offset) const
+    {
+        offset = static_cast<int>(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+        offset = glm::clamp(offset, 0, count() - 1);
+
+        float du = u - cdf[offset];
+        if (cdf[offset + 1] - cdf[offset] > 0)
+            du /= cdf[offset + 1] - cdf[offset];
+
+        pdf = integral > 0 ? func[offset] / integral : 1.f;
+        return std::min((offset + du) / count(), 1.f - std::numeric_limits<float>::epsilon());
+    }
+
+    inline Distribution2D::Distribution2D(const float *f, int nu, int nv)
+    {
+        conditional.reserve(nv);
+        for (int v = 0; v < nv; ++v)
+            conditional.emplace_back(&f[v * nu], nu);
+
+        vector<float> marginal_func(nv);
+        for (int v = 0; v < nv; ++v)
+            marginal_func[v] = conditional[v].integral;
+        marginal = Distribution1D(marginal_func.data(), nv);
+    }
+
+    inline vec2 Distribution2D::sample(const vec2 &u, float &pdf) const
+    {
+        float pdf_u, pdf_v;
+        int u_offset, v_offset;
+        float v = marginal.sample(u.y, pdf_v, v_offset);
+        float s = conditional[v_offset].sample(u.x, pdf_u, u_offset);
+        pdf = pdf_u * pdf_v;
+        return vec2(s, v);
+    }
+
+    inline float Distribution2D::getPDF(const vec2 &p) const
+    {
+        int iu = glm::clamp(static_cast<int>(p.x * conditional[0].count()), 0, conditional[0].count() - 1);
+        int iv = glm::clamp(static_cast<int>(p.y * marginal.count()), 0, marginal.count() - 1);
+        if (marginal.integral == 0)
+            return 1.f;
+        return conditional[iv].func[iu] / marginal.integral;
+    }
+}
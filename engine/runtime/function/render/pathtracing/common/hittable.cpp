@@ -4,23 +4,33 @@ namespace MiniEngine::PathTracing
 {
     bool HittableList::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
-        HitRecord temp_rec;
         bool hit_anything = false;
         auto closest_so_far = t_max;
 
+        // a miss leaves the record untouched, so every object can write the closest hit directly
         for (const auto &object : objects)
         {
-            if (object->hit(r, t_min, closest_so_far, temp_rec))
+            if (object->hit(r, t_min, closest_so_far, rec))
             {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
         return hit_anything;
     }
 
+    bool HittableList::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        for (const auto &object : objects)
+        {
+            if (object->occluded(r, t_min, t_max))
+                return true;
+        }
+
+        return false;
+    }
+
     float HittableList::getPDF(const vec3 &o, const vec3 &v) const
     {
         auto weight = 1.0 / objects.size();
@@ -7,19 +7,40 @@
 namespace MiniEngine::PathTracing
 {
     class Material;
+    class Hittable;
 
+    // Intersection only writes the distance, the surface parameters and the primitive that was hit. The shading
+    // attributes are left alone until resolve() fills them in for the closest hit, so the many candidates that are
+    // superseded during traversal cost neither the interpolation nor a material reference.
     struct HitRecord
     {
-        MiniEngine::Vertex hit_point;
-        shared_ptr<Material> mat_ptr;
         float t;
+        float u, v;                // barycentrics of the second and third corner for triangles
+        const Hittable *prim;      // primitive that was hit
+        const Hittable *object;    // where resolve() starts, the primitive or the outermost instance around it
+
+        MiniEngine::Vertex hit_point;
+        const Material *mat_ptr;
+        uint32_t material_id;      // entry of mat_ptr for materials that are tables
         bool front_face;
 
+        // change of the position along the texture coordinates, zero for surfaces without them
+        vec3 dpdu, dpdv;
+        // footprint of the ray differentials, on the surface and in texture space
+        bool has_differentials;
+        vec3 dpdx, dpdy;
+        vec2 duvdx, duvdy;
+
         inline void setFaceNormal(const Ray &r, const vec3 &outward_normal)
         {
             front_face = dot(r.direction, outward_normal) < 0;
             hit_point.Normal = front_face ? outward_normal : -outward_normal;
         }
+
+        inline void resolve(const Ray &r);
+
+    private:
+        inline void computeDifferentials(const Ray &r);
     };
 
     class Hittable
@@ -33,6 +54,33 @@ namespace MiniEngine::PathTracing
             return 0.0;
         }
 
+        // Bounds of the parts of this object on either side of an axis aligned plane, restricted to box. Used by
+        // spatial splits, the default just cuts the box and shapes that can do better return tighter bounds.
+        virtual void splitAABB(int axis, float position, const AABB &box, AABB &left, AABB &right) const
+        {
+            left = box;
+            right = box;
+            left.max[axis] = position;
+            right.min[axis] = position;
+        }
+
+        // Computes the shading attributes of a hit from what hit() recorded. Aggregates forward to the primitive
+        // and instances to what they hold, after moving the ray into its space.
+        virtual void fillHit(const Ray &r, HitRecord &rec) const {}
+
+        // whether anything lies between t_min and t_max, for rays that do not need the closest hit
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const
+        {
+            HitRecord rec;
+            return hit(r, t_min, t_max, rec);
+        }
+
+        // triangles hand out their corners so an acceleration structure can intersect several of them at once
+        virtual bool getTriangle(vec3 &v0, vec3 &v1, vec3 &v2) const
+        {
+            return false;
+        }
+
         virtual float getPDF(const vec3 &o, const vec3 &v) const
         {
             return 0.0;
@@ -57,8 +105,61 @@ namespace MiniEngine::PathTracing
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
         virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override { rec.prim->fillHit(r, rec); }
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
         virtual float getPDF(const vec3 &o, const vec3 &v) const override;
         virtual vec3 random(const vec3 &o) const override;
     };
 
+    inline void HitRecord::resolve(const Ray &r)
+    {
+        dpdu = dpdv = vec3(0, 0, 0);
+        object->fillHit(r, *this);
+        computeDifferentials(r);
+    }
+
+    inline void HitRecord::computeDifferentials(const Ray &r)
+    {
+        has_differentials = false;
+        dpdx = dpdy = vec3(0, 0, 0);
+        duvdx = duvdy = vec2(0, 0);
+        if (!r.has_differentials)
+            return;
+
+        // where the offset rays meet the tangent plane of the hit
+        const vec3 &n = hit_point.Normal;
+        const vec3 &p = hit_point.Position;
+        float d = dot(n, p);
+        float tx = (d - dot(n, r.rx_origin)) / dot(n, r.rx_direction);
+        float ty = (d - dot(n, r.ry_origin)) / dot(n, r.ry_direction);
+        if (!std::isfinite(tx) || !std::isfinite(ty))
+            return;
+
+        has_differentials = true;
+        dpdx = r.rx_origin + tx * r.rx_direction - p;
+        dpdy = r.ry_origin + ty * r.ry_direction - p;
+
+        // dp = dpdu du + dpdv dv, solved on the two axes the plane projects onto best
+        int axis0, axis1;
+        vec3 an = abs(n);
+        if (an.x > an.y && an.x > an.z)
+            axis0 = 1, axis1 = 2;
+        else if (an.y > an.z)
+            axis0 = 0, axis1 = 2;
+        else
+            axis0 = 0, axis1 = 1;
+
+        float det = dpdu[axis0] * dpdv[axis1] - dpdv[axis0] * dpdu[axis1];
+        if (fabs(det) < 1e-12f)
+            return;
+
+        auto solve = [&](const vec3 &dp)
+        {
+            float du = (dpdv[axis1] * dp[axis0] - dpdv[axis0] * dp[axis1]) / det;
+            float dv = (dpdu[axis0] * dp[axis1] - dpdu[axis1] * dp[axis0]) / det;
+            return std::isfinite(du) && std::isfinite(dv) ? vec2(du, dv) : vec2(0, 0);
+        };
+        duvdx = solve(dpdx);
+        duvdy = solve(dpdy);
+    }
 }
@@ -0,0 +1,180 @@
+#include "runtime/function/render/pathtracing/common/material.h"
+
+namespace MiniEngine::PathTracing
+{
+    uint32_t MaterialTable::add(const MiniEngine::Material &m, const std::string &path, const TextureCache &cache)
+    {
+        PackedMaterial packed;
+        packed.kd = m.Kd;
+        packed.ks = m.Ks;
+        packed.ke = m.Ke;
+        packed.tr = m.Tr;
+        packed.ior = m.Ni;
+        packed.roughness = GGXPDF::roughnessFromPhong(m.Ns);
+
+        packed.flags = 0;
+        if (m.Ke[0] > 0 || m.Ke[1] > 0 || m.Ke[2] > 0)
+            packed.flags |= MATERIAL_EMISSIVE;
+        if (m.Ks[0] > 0 || m.Ks[1] > 0 || m.Ks[2] > 0)
+            packed.flags |= MATERIAL_SPECULAR;
+        if (m.Ni > 1)
+            packed.flags |= MATERIAL_TRANSPARENT;
+
+        packed.diffuse_texture = -1;
+        if (!m.map_Kd.empty())
+        {
+            std::string file = path + "/" + m.map_Kd;
+            auto found = texture_ids.find(file);
+            if (found == texture_ids.end())
+            {
+                auto image = cache.get(file);
+                if (image && image->isValid())
+                {
+                    found = texture_ids.emplace(file, static_cast<int32_t>(textures.size())).first;
+                    textures.push_back(image);
+                }
+                else
+                    std::cerr << "ERROR: Could not load texture image file '" << file << "'.\n";
+            }
+            if (found != texture_ids.end())
+                packed.diffuse_texture = found->second;
+        }
+
+        materials.push_back(packed);
+        return static_cast<uint32_t>(materials.size() - 1);
+    }
+
+    bool MaterialTable::scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const
+    {
+        const PackedMaterial &mat = materials[rec.material_id];
+        if (mat.flags & MATERIAL_EMISSIVE)
+        {
+            return false;
+        }
+
+        bool specular = mat.flags & MATERIAL_SPECULAR;
+        if (specular && linearRand(0.f, 1.f) < GLOSSY_LOBE_PROBABILITY)
+        {
+            // attenuation is the reflectance at normal incidence, evalScatter() adds the angular terms
+            srec.attenuation = mat.ks;
+            srec.is_specular = false;
+            srec.is_glossy = true;
+            srec.pdf_ptr = make_shared<GGXPDF>(rec.hit_point.Normal, -r_in.direction, mat.roughness);
+
+            return true;
+        }
+
+        if (mat.flags & MATERIAL_TRANSPARENT)
+        {
+            float refraction_ratio = rec.front_face ? (1.0 / mat.ior) : mat.ior;
+
+            vec3 unit_direction = normalize(r_in.direction);
+            float cos_theta = fmin(dot(-unit_direction, rec.hit_point.Normal), 1.0);
+            float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+
+            bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+            vec3 direction;
+
+            bool reflected = cannot_refract || reflectance(cos_theta, refraction_ratio) > linearRand(0.f, 1.f);
+            if (reflected)
+                direction = reflect(unit_direction, rec.hit_point.Normal);
+            else
+                direction = refract(unit_direction, rec.hit_point.Normal, refraction_ratio);
+
+            srec.is_specular = true;
+            srec.pdf_ptr = nullptr;
+            srec.attenuation = mat.tr;
+            if (specular)
+                srec.attenuation /= 1 - GLOSSY_LOBE_PROBABILITY;
+            srec.specular_ray = Ray(rec.hit_point.Position, direction);
+
+            // the surfaces are flat, so the neighbouring rays bend by the same normal from where they hit it
+            if (rec.has_differentials)
+            {
+                vec3 rx = normalize(r_in.rx_direction);
+                vec3 ry = normalize(r_in.ry_direction);
+                vec3 dx = reflected ? reflect(rx, rec.hit_point.Normal) : refract(rx, rec.hit_point.Normal, refraction_ratio);
+                vec3 dy = reflected ? reflect(ry, rec.hit_point.Normal) : refract(ry, rec.hit_point.Normal, refraction_ratio);
+
+                // a neighbour that is totally reflected has no refracted ray to follow
+                if (dot(dx, dx) > 0 && dot(dy, dy) > 0)
+                {
+                    srec.specular_ray.has_differentials = true;
+                    srec.specular_ray.rx_origin = rec.hit_point.Position + rec.dpdx;
+                    srec.specular_ray.ry_origin = rec.hit_point.Position + rec.dpdy;
+                    srec.specular_ray.rx_direction = dx;
+                    srec.specular_ray.ry_direction = dy;
+                }
+            }
+
+            return true;
+        }
+
+        srec.attenuation = mat.kd;
+        if (mat.diffuse_texture >= 0)
+        {
+            // images that failed to load are never referenced, Kd stays for them
+            srec.attenuation = textures[mat.diffuse_texture]->filter(rec.hit_point.Texcoord, rec.duvdx, rec.duvdy);
+        }
+
+        if (specular)
+            srec.attenuation /= 1 - GLOSSY_LOBE_PROBABILITY;
+
+        srec.is_specular = false;
+        srec.is_glossy = false;
+        srec.pdf_ptr = make_shared<CosinePDF>(rec.hit_point.Normal);
+        return true;
+    }
+
+    vec3 MaterialTable::getAlbedo(const HitRecord &rec) const
+    {
+        const PackedMaterial &mat = materials[rec.material_id];
+        if (mat.flags & MATERIAL_TRANSPARENT)
+            return mat.tr;
+
+        // the diffuse color as it is shaded plus the specular reflectance at normal incidence
+        vec3 albedo = mat.kd;
+        if (mat.diffuse_texture >= 0)
+            albedo = textures[mat.diffuse_texture]->filter(rec.hit_point.Texcoord, rec.duvdx, rec.duvdy);
+        if (mat.flags & MATERIAL_SPECULAR)
+            albedo += mat.ks;
+        return glm::clamp(albedo, 0.f, 1.f);
+    }
+
+    vec3 MaterialTable::emitted(const Ray &r_in, const HitRecord &rec) const
+    {
+        const PackedMaterial &mat = materials[rec.material_id];
+        if ((mat.flags & MATERIAL_EMISSIVE) && rec.front_face)
+            return mat.ke;
+        else
+            return vec3(0, 0, 0);
+    }
+
+    float MaterialTable::scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const
+    {
+        auto cosine = dot(rec.hit_point.Normal, scattered.direction);
+        return cosine < 0 ? 0 : cosine / PI;
+    }
+
+    vec3 MaterialTable::evalScatter(const Ray &r_in, const HitRecord &rec, const ScatterRecord &srec, const Ray &scattered) const
+    {
+        if (!srec.is_glossy)
+            return srec.attenuation * scatterPDF(r_in, rec, scattered);
+
+        // Cook-Torrance with separable Smith masking and Schlick's Fresnel, divided by the lobe probability
+        const PackedMaterial &mat = materials[rec.material_id];
+        vec3 wo = -normalize(r_in.direction);
+        vec3 wi = normalize(scattered.direction);
+        float cos_o = dot(rec.hit_point.Normal, wo);
+        float cos_i = dot(rec.hit_point.Normal, wi);
+        if (cos_o <= 0 || cos_i <= 0)
+            return vec3(0, 0, 0);
+
+        vec3 h = normalize(wo + wi);
+        vec3 fresnel = srec.attenuation + (1.f - srec.attenuation) * pow(1 - std::max(dot(wo, h), 0.f), 5.f);
+        float d = GGXPDF::D(dot(rec.hit_point.Normal, h), mat.roughness);
+        float g = GGXPDF::G1(cos_o, mat.roughness) * GGXPDF::G1(cos_i, mat.roughness);
+
+        return fresnel * d * g / (4 * cos_o * GLOSSY_LOBE_PROBABILITY);
+    }
+}
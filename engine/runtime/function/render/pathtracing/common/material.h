@@ -3,9 +3,13 @@
 #include "runtime/function/render/pathtracing/common/util.h"
 #include "runtime/function/render/pathtracing/common/onb.h"
 #include "runtime/function/render/pathtracing/common/pdf.h"
+#include "runtime/function/render/pathtracing/common/texture_cache.h"
 #include "runtime/function/render/render_mesh.h"
 #include "runtime/function/render/render_texture.h"
 
+#include <string>
+#include <unordered_map>
+
 namespace MiniEngine::PathTracing
 {
     struct HitRecord;
@@ -16,6 +20,7 @@ namespace MiniEngine::PathTracing
         bool is_specular;
         vec3 attenuation;
         shared_ptr<PDF> pdf_ptr;
+        bool is_glossy{false}; // the microfacet lobe of a material table was picked
     };
 
     class Material
@@ -31,10 +36,22 @@ namespace MiniEngine::PathTracing
             return 0;
         }
 
+        // BSDF times the cosine towards scattered, for the lobe scatter() picked
+        virtual vec3 evalScatter(const Ray &r_in, const HitRecord &rec, const ScatterRecord &srec, const Ray &scattered) const
+        {
+            return srec.attenuation * scatterPDF(r_in, rec, scattered);
+        }
+
         virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const
         {
             return vec3(0, 0, 0);
         }
+
+        // reflectance of the surface over all directions, guides the denoiser. White if a material cannot say.
+        virtual vec3 getAlbedo(const HitRecord &rec) const
+        {
+            return vec3(1, 1, 1);
+        }
     };
 
     class Lambertian : public Material
@@ -57,6 +74,11 @@ namespace MiniEngine::PathTracing
             auto cosine = dot(rec.hit_point.Normal, scattered.direction);
             return cosine < 0 ? 0 : cosine / PI;
         }
+
+        virtual vec3 getAlbedo(const HitRecord &rec) const override
+        {
+            return albedo;
+        }
     };
 
     class Metal : public Material
@@ -140,132 +162,54 @@ namespace MiniEngine::PathTracing
         }
     };
 
-    class Phong : public Material
+    enum MaterialFlags : uint32_t
     {
-    public:
-        MiniEngine::Material mat;
-        shared_ptr<Texture> diffuse_map;
-
-        Phong(MiniEngine::Material m, std::string path)
-        {
-            this->mat = m;
-            diffuse_map = make_shared<Image>((path + "/" + mat.map_Kd).c_str());
-        }
+        MATERIAL_EMISSIVE = 1 << 0,
+        MATERIAL_SPECULAR = 1 << 1,
+        MATERIAL_TRANSPARENT = 1 << 2,
+    };
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
-        {
-            if (is_emitted(mat))
-            {
-                return false;
-            }
-
-            if (is_specular(mat) && linearRand(0.f, 1.f) < 0.5f)
-            {
-                vec3 reflected = reflect(r_in.direction, rec.hit_point.Normal);
-                vec3 noise = 1.f / log(mat.Ns) * ballRand(1.f);
-
-                vec3 normal = normalize(rec.hit_point.Normal);
-                vec3 tangent = normalize(cross(normal, cross(reflected, normal)));
-                vec3 bi_tangent = normalize(cross(normal, tangent));
-
-                f32 noise_n = dot(noise, normal);
-                f32 noise_t = dot(noise, tangent);
-                f32 noise_bt = dot(noise, bi_tangent);
-
-                noise_t = noise_t / dot(normalize(reflected), normal);
-                noise_bt = noise_bt * dot(normalize(reflected), normal);
-
-                noise = normal * noise_n + tangent * noise_t + bi_tangent * noise_bt;
-
-                srec.specular_ray = Ray(rec.hit_point.Position, reflected + noise);
-                srec.attenuation = mat.Ks;
-                srec.is_specular = true;
-                srec.pdf_ptr = nullptr;
-
-                return true;
-            }
-
-            if (is_transparent(mat))
-            {
-                float refraction_ratio = rec.front_face ? (1.0 / mat.Ni) : mat.Ni;
-
-                vec3 unit_direction = normalize(r_in.direction);
-                float cos_theta = fmin(dot(-unit_direction, rec.hit_point.Normal), 1.0);
-                float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
-
-                bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-                vec3 direction;
-
-                if (cannot_refract || reflectance(cos_theta, refraction_ratio) > linearRand(0.f, 1.f))
-                    direction = reflect(unit_direction, rec.hit_point.Normal);
-                else
-                    direction = refract(unit_direction, rec.hit_point.Normal, refraction_ratio);
-
-                srec.is_specular = true;
-                srec.pdf_ptr = nullptr;
-                srec.attenuation = mat.Tr;
-                srec.specular_ray = Ray(rec.hit_point.Position, direction);
-
-                return true;
-            }
-
-            auto attenuation =  diffuse_map->value(rec.hit_point.Texcoord.s, rec.hit_point.Texcoord.t, rec.hit_point.Position);
-            if (attenuation[0]<0)
-            {
-                srec.attenuation = mat.Kd;
-            }
-            else
-            {
-                srec.attenuation = attenuation;
-            }
+    // A Phong material of a loaded model, compiled once so that shading reads plain values instead of
+    // re-deriving lobes from the source material.
+    struct PackedMaterial
+    {
+        vec3 kd;
+        uint32_t flags;
+        vec3 ks;
+        float roughness; // GGX alpha of the specular lobe, mapped from Ns
+        vec3 ke;
+        float ior;
+        vec3 tr;
+        int32_t diffuse_texture; // index into the textures of the table, -1 for none
+    };
 
-            srec.is_specular = false;
-            srec.pdf_ptr = make_shared<CosinePDF>(rec.hit_point.Normal);
-            return true;
-        }
+    static_assert(sizeof(PackedMaterial) == 64, "PackedMaterial should fill exactly one cache line");
 
-        virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const override
-        {
-            if (is_emitted(mat) && rec.front_face)
-                return mat.Ke;
-            else
-                return vec3(0, 0, 0);
-        }
+    // The materials of a model as one contiguous array, selected by the material id of the hit. Triangles of the
+    // model all point at the same table, and textures come linear from the shared texture cache. Specular
+    // materials pick the diffuse or the GGX lobe with equal probability, both are sampled with a pdf so they take
+    // part in light sampling.
+    class MaterialTable : public Material
+    {
+    public:
+        vector<PackedMaterial> materials;
+        vector<shared_ptr<const LinearImage>> textures;
 
-        float scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const override
-        {
-            auto cosine = dot(rec.hit_point.Normal, scattered.direction);
-            return cosine < 0 ? 0 : cosine / PI;
-        }
+        // the diffuse map has to be in the cache already, see TextureCache::load()
+        uint32_t add(const MiniEngine::Material &m, const std::string &path, const TextureCache &cache);
+        bool isEmissive(uint32_t id) const { return materials[id].flags & MATERIAL_EMISSIVE; }
 
-        inline bool is_transparent(MiniEngine::Material mat) const
-        {
-            if (mat.Ni > 1)
-            {
-                return true;
-            }
-            return false;
-        }
+        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override;
+        virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const override;
+        virtual float scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const override;
+        virtual vec3 evalScatter(const Ray &r_in, const HitRecord &rec, const ScatterRecord &srec, const Ray &scattered) const override;
+        virtual vec3 getAlbedo(const HitRecord &rec) const override;
 
-        inline bool is_emitted(MiniEngine::Material mat) const
-        {
-            if (mat.Ke[0] > 0 || mat.Ke[1] > 0 || mat.Ke[2] > 0)
-            {
-                return true;
-            }
-            return false;
-        }
+    private:
+        static constexpr float GLOSSY_LOBE_PROBABILITY = 0.5f;
 
-        inline bool is_specular(MiniEngine::Material mat) const
-        {
-            if (mat.Ks[0] > 0 || mat.Ks[1] > 0 || mat.Ks[2] > 0)
-            {
-                return true;
-            }
-            return false;
-        }
+        std::unordered_map<std::string, int32_t> texture_ids;
 
-    private:
         static float reflectance(float cosine, float ref_idx)
         {
             // Use Schlick's approximation for reflectance.
@@ -2,6 +2,7 @@
 
 #include "runtime/function/render/pathtracing/common/util.h"
 #include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/common/onb.h"
 
 namespace MiniEngine::PathTracing
 {
@@ -36,6 +37,84 @@ namespace MiniEngine::PathTracing
         }
     };
 
+    // Trowbridge-Reitz (GGX) reflection around the normal, sampled through the distribution of the normals visible
+    // from the outgoing direction (Heitz 2018), so few samples are wasted below the horizon or on masked facets.
+    class GGXPDF : public PDF
+    {
+    public:
+        ONB onb;
+        vec3 wo; // outgoing direction in the local frame, z along the normal
+        float alpha;
+
+        GGXPDF(const vec3 &normal, const vec3 &outgoing, float roughness) : alpha(roughness)
+        {
+            onb.buildONB(normal);
+            wo = toLocal(normalize(outgoing));
+        }
+
+        virtual float value(const vec3 &direction) const override
+        {
+            vec3 wi = toLocal(normalize(direction));
+            if (wi.z <= 0 || wo.z <= 0)
+                return 0;
+
+            vec3 h = normalize(wo + wi);
+            return G1(wo.z, alpha) * D(h.z, alpha) / (4 * wo.z);
+        }
+
+        virtual vec3 generate() const override
+        {
+            vec3 h = sampleVisibleNormal(linearRand(0.f, 1.f), linearRand(0.f, 1.f));
+            return onb.local(reflect(-wo, h));
+        }
+
+        // normal distribution, for the cosine between normal and half vector
+        static float D(float cos_h, float alpha)
+        {
+            float a2 = alpha * alpha;
+            float d = cos_h * cos_h * (a2 - 1) + 1;
+            return a2 / (PI * d * d);
+        }
+
+        // Smith masking of one direction
+        static float G1(float cos_v, float alpha)
+        {
+            float a2 = alpha * alpha;
+            return 2 * cos_v / (cos_v + sqrt(a2 + (1 - a2) * cos_v * cos_v));
+        }
+
+        // a roughness with about the highlight of a Phong lobe of exponent ns
+        static float roughnessFromPhong(float ns)
+        {
+            return glm::clamp(sqrt(2 / (ns + 2)), 1e-3f, 1.f);
+        }
+
+    private:
+        vec3 toLocal(const vec3 &v) const
+        {
+            return vec3(dot(v, onb.axis[0]), dot(v, onb.axis[1]), dot(v, onb.axis[2]));
+        }
+
+        vec3 sampleVisibleNormal(float u1, float u2) const
+        {
+            // stretch to the hemisphere configuration, sample the projected disk there and map back
+            vec3 vh = normalize(vec3(alpha * wo.x, alpha * wo.y, wo.z));
+            float lensq = vh.x * vh.x + vh.y * vh.y;
+            vec3 t1 = lensq > 0 ? vec3(-vh.y, vh.x, 0) / sqrt(lensq) : vec3(1, 0, 0);
+            vec3 t2 = cross(vh, t1);
+
+            float r = sqrt(u1);
+            float phi = 2 * PI * u2;
+            float p1 = r * cos(phi);
+            float p2 = r * sin(phi);
+            float s = 0.5f * (1 + vh.z);
+            p2 = (1 - s) * sqrt(1 - p1 * p1) + s * p2;
+
+            vec3 nh = p1 * t1 + p2 * t2 + sqrt(std::max(0.f, 1 - p1 * p1 - p2 * p2)) * vh;
+            return normalize(vec3(alpha * nh.x, alpha * nh.y, std::max(0.f, nh.z)));
+        }
+    };
+
     class HittablePDF : public PDF
     {
     public:
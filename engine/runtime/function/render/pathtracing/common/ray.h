@@ -11,11 +11,28 @@ namespace MiniEngine::PathTracing
         glm::vec3 origin;
         glm::vec3 direction;
 
-        Ray() {}
+        // reciprocal direction and its sign bits, precomputed once per ray for the slab test
+        glm::vec3 inv_direction;
+        int sign[3];
+
+        // rays through the neighbouring pixels, carried along so a hit knows the footprint it covers on the
+        // surface and textures can be filtered over it
+        bool has_differentials{false};
+        glm::vec3 rx_origin, rx_direction;
+        glm::vec3 ry_origin, ry_direction;
+
+        // along +z from the origin, so the slab test never reads an unset reciprocal
+        Ray() : Ray(glm::vec3(0, 0, 0), glm::vec3(0, 0, 1)) {}
         Ray(const glm::vec3 &origin, const glm::vec3 &direction)
         {
             this->origin=origin;
             this->direction=glm::normalize(direction);
+
+            // a zero component yields a signed infinity, the slab test relies on IEEE semantics for it
+            inv_direction = 1.f / this->direction;
+            sign[0] = inv_direction.x < 0;
+            sign[1] = inv_direction.y < 0;
+            sign[2] = inv_direction.z < 0;
         }
 
         glm::vec3 cast(float t) const
@@ -23,6 +40,15 @@ namespace MiniEngine::PathTracing
             return origin + glm::f32(t) * direction;
         }
 
+        // shrinks the footprint to the spacing of s times as many samples
+        void scaleDifferentials(float s)
+        {
+            rx_origin = origin + (rx_origin - origin) * s;
+            ry_origin = origin + (ry_origin - origin) * s;
+            rx_direction = direction + (rx_direction - direction) * s;
+            ry_direction = direction + (ry_direction - direction) * s;
+        }
+
     };
 
-}
\ No newline at end of file
+}
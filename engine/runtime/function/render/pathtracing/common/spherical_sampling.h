@@ -0,0 +1,245 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Solid angle sampling of area lights: directions are drawn uniformly over the part of the sphere of directions
+    // the light covers as seen from the shading point, so the pdf is just one over that solid angle. Near a light
+    // this is much less noisy than picking points uniformly by area. Solid angles too small for the spherical
+    // formulas to stay accurate in float, or close to a hemisphere, fall back to area sampling.
+    const float MIN_SPHERICAL_SAMPLE_AREA = 3e-4f;
+    const float MAX_SPHERICAL_SAMPLE_AREA = 6.22f;
+
+    // Arvo 1995, "Stratified Sampling of Spherical Triangles"
+    class SphericalTriangle
+    {
+    public:
+        SphericalTriangle(const vec3 &origin, const vec3 &p0, const vec3 &p1, const vec3 &p2);
+
+        // direction from the origin towards the triangle, zero if there is none
+        vec3 sample(const vec2 &u) const;
+        // pdf with respect to solid angle, zero for directions missing the triangle
+        float getPDF(const vec3 &direction) const;
+
+    private:
+        vec3 origin;
+        vec3 p[3];
+        vec3 a, b, c; // corners projected onto the unit sphere around the origin
+        vec3 normal;
+        float area;
+        float alpha;
+        float solid_angle{0.f};
+
+        bool contains(const vec3 &direction) const;
+    };
+
+    // Urena, Fajardo and King 2013, "An Area-Preserving Parametrization for Spherical Rectangles"
+    class SphericalRectangle
+    {
+    public:
+        // the rectangle spanned by the edges ex and ey from corner, which have to be perpendicular
+        SphericalRectangle(const vec3 &origin, const vec3 &corner, const vec3 &ex, const vec3 &ey);
+
+        vec3 sample(const vec2 &u) const;
+        float getPDF(const vec3 &direction) const;
+
+    private:
+        vec3 origin;
+        vec3 corner;
+        vec3 ex, ey;
+        float area;
+
+        // local frame with the origin at zero and the rectangle in the plane z = z0 < 0
+        vec3 x, y, z;
+        float x0, y0, z0, x1, y1;
+        float b0, b1, k;
+        float solid_angle{0.f};
+
+        bool contains(const vec3 &direction, float &distance) const;
+    };
+
+    inline SphericalTriangle::SphericalTriangle(const vec3 &o, const vec3 &p0, const vec3 &p1, const vec3 &p2) : origin(o), p{p0, p1, p2}
+    {
+        vec3 cross_product = cross(p1 - p0, p2 - p0);
+        area = 0.5f * length(cross_product);
+        normal = area > 0.f ? normalize(cross_product) : vec3(0.f);
+        alpha = 0.f;
+
+        vec3 da = p0 - o, db = p1 - o, dc = p2 - o;
+        if (dot(da, da) == 0.f || dot(db, db) == 0.f || dot(dc, dc) == 0.f)
+            return;
+
+        a = normalize(da);
+        b = normalize(db);
+        c = normalize(dc);
+
+        // Van Oosterom and Strackee, well conditioned even for small triangles
+        float triple = dot(a, cross(b, c));
+        solid_angle = fabs(2.f * atan2(triple, 1.f + dot(a, b) + dot(b, c) + dot(c, a)));
+        if (solid_angle < MIN_SPHERICAL_SAMPLE_AREA || solid_angle > MAX_SPHERICAL_SAMPLE_AREA)
+            return;
+
+        // interior angle at a, between the great circles through ab and ac
+        vec3 n_ab = cross(a, b), n_ac = cross(a, c);
+        if (dot(n_ab, n_ab) == 0.f || dot(n_ac, n_ac) == 0.f)
+        {
+            solid_angle = 0.f;
+            return;
+        }
+        alpha = acos(glm::clamp(dot(normalize(n_ab), normalize(n_ac)), -1.f, 1.f));
+    }
+
+    inline bool SphericalTriangle::contains(const vec3 &direction) const
+    {
+        // inside the cone spanned by the corners, on the inner side of all three edge planes
+        vec3 da = p[0] - origin, db = p[1] - origin, dc = p[2] - origin;
+        float orientation = dot(da, cross(db, dc));
+        return dot(direction, cross(da, db)) * orientation >= 0.f &&
+               dot(direction, cross(db, dc)) * orientation >= 0.f &&
+               dot(direction, cross(dc, da)) * orientation >= 0.f;
+    }
+
+    inline vec3 SphericalTriangle::sample(const vec2 &u) const
+    {
+        if (alpha == 0.f)
+        {
+            float su = sqrt(u.x);
+            return (1.f - su) * p[0] + su * (1.f - u.y) * p[1] + su * u.y * p[2] - origin;
+        }
+
+        // pick the sub-triangle a b c' with the right share of the solid angle, then a point along b c'
+        float sub_area = u.x * solid_angle;
+        float s = sin(sub_area - alpha);
+        float t = cos(sub_area - alpha);
+        float cos_alpha = cos(alpha);
+        float sin_alpha = sin(alpha);
+        float u_ = t - cos_alpha;
+        float v_ = s + sin_alpha * dot(a, b);
+
+        float q = glm::clamp(((v_ * t - u_ * s) * cos_alpha - v_) / ((v_ * s + u_ * t) * sin_alpha), -1.f, 1.f);
+        vec3 c_perp = c - dot(c, a) * a;
+        vec3 c_ = q * a + sqrt(std::max(0.f, 1.f - q * q)) * (dot(c_perp, c_perp) > 0.f ? normalize(c_perp) : vec3(0.f));
+
+        float z = 1.f - u.y * (1.f - dot(c_, b));
+        vec3 c_b = c_ - dot(c_, b) * b;
+        return z * b + sqrt(std::max(0.f, 1.f - z * z)) * (dot(c_b, c_b) > 0.f ? normalize(c_b) : vec3(0.f));
+    }
+
+    inline float SphericalTriangle::getPDF(const vec3 &direction) const
+    {
+        if (solid_angle == 0.f || area == 0.f || !contains(direction))
+            return 0.f;
+        if (alpha != 0.f)
+            return 1.f / solid_angle;
+
+        // area sampling, the distance to the plane comes in closed form once the direction is known to hit
+        vec3 d = normalize(direction);
+        float cosine = fabs(dot(d, normal));
+        if (cosine == 0.f)
+            return 0.f;
+        float distance = fabs(dot(p[0] - origin, normal)) / cosine;
+        return distance * distance / (cosine * area);
+    }
+
+    inline SphericalRectangle::SphericalRectangle(const vec3 &o, const vec3 &s, const vec3 &e0, const vec3 &e1) : origin(o), corner(s), ex(e0), ey(e1)
+    {
+        float ex_length = length(ex);
+        float ey_length = length(ey);
+        area = ex_length * ey_length;
+        if (area == 0.f)
+            return;
+
+        x = ex / ex_length;
+        y = ey / ey_length;
+        z = cross(x, y);
+
+        vec3 d = corner - origin;
+        x0 = dot(d, x);
+        y0 = dot(d, y);
+        z0 = dot(d, z);
+        if (z0 > 0.f)
+        {
+            z = -z;
+            z0 = -z0;
+        }
+        x1 = x0 + ex_length;
+        y1 = y0 + ey_length;
+
+        vec3 v00(x0, y0, z0), v01(x0, y1, z0), v10(x1, y0, z0), v11(x1, y1, z0);
+        vec3 n0 = cross(v00, v10), n1 = cross(v10, v11), n2 = cross(v11, v01), n3 = cross(v01, v00);
+        if (z0 == 0.f || dot(n0, n0) == 0.f || dot(n1, n1) == 0.f || dot(n2, n2) == 0.f || dot(n3, n3) == 0.f)
+            return;
+        n0 = normalize(n0);
+        n1 = normalize(n1);
+        n2 = normalize(n2);
+        n3 = normalize(n3);
+
+        // interior angles of the spherical rectangle
+        float g0 = acos(glm::clamp(-dot(n0, n1), -1.f, 1.f));
+        float g1 = acos(glm::clamp(-dot(n1, n2), -1.f, 1.f));
+        float g2 = acos(glm::clamp(-dot(n2, n3), -1.f, 1.f));
+        float g3 = acos(glm::clamp(-dot(n3, n0), -1.f, 1.f));
+
+        b0 = n0.z;
+        b1 = n2.z;
+        k = 2.f * PI - g2 - g3;
+        solid_angle = g0 + g1 - k;
+    }
+
+    inline bool SphericalRectangle::contains(const vec3 &direction, float &distance) const
+    {
+        if (area == 0.f)
+            return false;
+
+        vec3 d = normalize(direction);
+        vec3 normal = cross(ex, ey);
+        float denominator = dot(d, normal);
+        if (denominator == 0.f)
+            return false;
+
+        distance = dot(corner - origin, normal) / denominator;
+        if (distance <= 0.f)
+            return false;
+
+        vec3 p = origin + distance * d - corner;
+        float px = dot(p, ex), py = dot(p, ey);
+        return px >= 0.f && px <= dot(ex, ex) && py >= 0.f && py <= dot(ey, ey);
+    }
+
+    inline vec3 SphericalRectangle::sample(const vec2 &u) const
+    {
+        if (solid_angle < MIN_SPHERICAL_SAMPLE_AREA || solid_angle > MAX_SPHERICAL_SAMPLE_AREA)
+            return corner + u.x * ex + u.y * ey - origin;
+
+        // the column xu splits off the right share of the solid angle
+        float au = u.x * solid_angle + k;
+        float fu = (cos(au) * b0 - b1) / sin(au);
+        float cu = glm::clamp((fu > 0.f ? 1.f : -1.f) / sqrt(fu * fu + b0 * b0), -1.f, 1.f);
+        float xu = glm::clamp(-(cu * z0) / std::max(sqrt(1.f - cu * cu), 1e-7f), x0, x1);
+
+        // then the height within that column
+        float distance = sqrt(xu * xu + z0 * z0);
+        float h0 = y0 / sqrt(distance * distance + y0 * y0);
+        float h1 = y1 / sqrt(distance * distance + y1 * y1);
+        float hv = h0 + u.y * (h1 - h0);
+        float hv2 = hv * hv;
+        float yv = hv2 < 1.f - 1e-6f ? hv * distance / sqrt(1.f - hv2) : y1;
+
+        return xu * x + yv * y + z0 * z;
+    }
+
+    inline float SphericalRectangle::getPDF(const vec3 &direction) const
+    {
+        float distance;
+        if (!contains(direction, distance))
+            return 0.f;
+        if (solid_angle >= MIN_SPHERICAL_SAMPLE_AREA && solid_angle <= MAX_SPHERICAL_SAMPLE_AREA)
+            return 1.f / solid_angle;
+
+        float cosine = fabs(dot(normalize(direction), z));
+        if (cosine == 0.f)
+            return 0.f;
+        return distance * distance / (cosine * area);
+    }
+}
@@ -0,0 +1,500 @@
+#include "runtime/function/render/pathtracing/common/texture_cache.h"
+#include "runtime/core/base/hash.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace MiniEngine::PathTracing
+{
+    static const uint32_t TEXTURE_PAGE_MAGIC = 0x5845544d; // "MTEX"
+
+    // the level table and the source path follow the header, tiles start on the next tile boundary. The source
+    // size and write time tell whether the file is stale without decoding anything.
+    struct TexturePageHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        uint64_t level_count;
+        uint64_t tile_count;
+        uint64_t tile_offset;
+        uint64_t source_size;
+        int64_t source_time;
+        uint64_t path_length;
+    };
+
+    static uint64_t getSourceSize(const std::string &file)
+    {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(file, error);
+        return error ? 0 : size;
+    }
+
+    static int64_t getSourceTime(const std::string &file)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(file, error);
+        return error ? std::filesystem::file_time_type::min().time_since_epoch().count() : time.time_since_epoch().count();
+    }
+
+    // the same gamma 2.2 the lookups used to apply, once per 8 bit value
+    static const std::array<float, 256> &getLinearTable()
+    {
+        static const std::array<float, 256> to_linear = []()
+        {
+            std::array<float, 256> table;
+            for (int i = 0; i < 256; ++i)
+                table[i] = pow(i / 255.f, 2.2f);
+            return table;
+        }();
+        return to_linear;
+    }
+
+    static unsigned char *loadPixels(const std::string &file, int &width, int &height)
+    {
+        // thread local, several files are decoded at once
+        stbi_set_flip_vertically_on_load_thread(true);
+        int channels;
+        unsigned char *data = stbi_load(file.c_str(), &width, &height, &channels, 3);
+        if (!data)
+            width = height = 0;
+        return data;
+    }
+
+    LinearImage::LinearImage(const std::string &file, const std::filesystem::path &page_file)
+    {
+        // a folder that cannot be written keeps the tiles in memory
+        if (!page_file.empty() && (mapPages(page_file) || (writePages(file, page_file) && mapPages(page_file))))
+            return;
+
+        levels.clear();
+        if (!decode(file))
+            return;
+        buildPyramid();
+    }
+
+    uint64_t LinearImage::layoutLevels()
+    {
+        // every level of the pyramid, halving down to a single texel
+        levels.clear();
+        uint64_t tile_count = 0;
+        for (int w = width, h = height;; w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        {
+            Level level;
+            level.width = w;
+            level.height = h;
+            level.tiles_x = (w + TextureTile::SIZE - 1) >> TextureTile::SIZE_LOG2;
+            level.tiles_y = (h + TextureTile::SIZE - 1) >> TextureTile::SIZE_LOG2;
+            level.first_tile = tile_count;
+            tile_count += static_cast<uint64_t>(level.tiles_x) * level.tiles_y;
+            levels.push_back(level);
+
+            if (w == 1 && h == 1)
+                break;
+        }
+        return tile_count;
+    }
+
+    void LinearImage::convertRow(const unsigned char *data, int tile_row, TextureTile *row) const
+    {
+        const auto &to_linear = getLinearTable();
+        const Level &l = levels[0];
+        std::fill(row, row + l.tiles_x, TextureTile{});
+
+        int y_end = std::min((tile_row + 1) << TextureTile::SIZE_LOG2, height);
+        for (int y = tile_row << TextureTile::SIZE_LOG2; y < y_end; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const unsigned char *c = data + 3 * (static_cast<size_t>(y) * width + x);
+                auto at = locate(l, x, y);
+                row[at.first - l.first_tile - static_cast<uint64_t>(tile_row) * l.tiles_x].texels[at.second] =
+                    vec3(to_linear[c[0]], to_linear[c[1]], to_linear[c[2]]);
+            }
+        }
+    }
+
+    // Box filtered halving into one row of tiles of the coarse level, odd sizes drop their last row or column.
+    // The fine rows read are those of tile rows 2 * tile_row and 2 * tile_row + 1 of the finer level.
+    template <typename Fetch>
+    void LinearImage::downsampleRow(const Level &coarse, int tile_row, Fetch fine_texel, TextureTile *row)
+    {
+        std::fill(row, row + coarse.tiles_x, TextureTile{});
+
+        int y_end = std::min((tile_row + 1) << TextureTile::SIZE_LOG2, coarse.height);
+        for (int y = tile_row << TextureTile::SIZE_LOG2; y < y_end; ++y)
+        {
+            for (int x = 0; x < coarse.width; ++x)
+            {
+                auto at = locate(coarse, x, y);
+                row[at.first - coarse.first_tile - static_cast<uint64_t>(tile_row) * coarse.tiles_x].texels[at.second] =
+                    0.25f * (fine_texel(2 * x, 2 * y) + fine_texel(2 * x + 1, 2 * y) + fine_texel(2 * x, 2 * y + 1) +
+                             fine_texel(2 * x + 1, 2 * y + 1));
+            }
+        }
+    }
+
+    bool LinearImage::decode(const std::string &file)
+    {
+        unsigned char *data = loadPixels(file, width, height);
+        if (!data)
+            return false;
+
+        resident.assign(layoutLevels(), TextureTile{});
+        tiles = resident.data();
+
+        const Level &l = levels[0];
+        for (int tile_row = 0; tile_row < l.tiles_y; ++tile_row)
+            convertRow(data, tile_row, &resident[l.first_tile + static_cast<uint64_t>(tile_row) * l.tiles_x]);
+        stbi_image_free(data);
+
+        return true;
+    }
+
+    void LinearImage::buildPyramid()
+    {
+        for (size_t i = 1; i < levels.size(); ++i)
+        {
+            const Level &fine = levels[i - 1];
+            const Level &coarse = levels[i];
+            auto fine_texel = [&](int x, int y)
+            { return texel(fine, std::min(x, fine.width - 1), std::min(y, fine.height - 1)); };
+
+            for (int tile_row = 0; tile_row < coarse.tiles_y; ++tile_row)
+                downsampleRow(coarse, tile_row, fine_texel, &resident[coarse.first_tile + static_cast<uint64_t>(tile_row) * coarse.tiles_x]);
+        }
+    }
+
+    bool LinearImage::mapPages(const std::filesystem::path &page_file)
+    {
+        if (!mapped.open(page_file))
+            return false;
+
+        TexturePageHeader header;
+        bool valid = mapped.size() >= sizeof(header);
+        if (valid)
+        {
+            memcpy(&header, mapped.data(), sizeof(header));
+            valid = header.magic == TEXTURE_PAGE_MAGIC && header.version == TEXTURE_PAGE_VERSION && header.level_count > 0 &&
+                    header.level_count <= (mapped.size() - sizeof(header)) / sizeof(Level) &&
+                    header.path_length <= mapped.size() &&
+                    sizeof(header) + header.level_count * sizeof(Level) + header.path_length <= header.tile_offset &&
+                    header.tile_offset % alignof(TextureTile) == 0 && header.tile_offset <= mapped.size() &&
+                    header.tile_count <= (mapped.size() - header.tile_offset) / sizeof(TextureTile);
+        }
+
+        vector<Level> table;
+        if (valid)
+        {
+            table.resize(header.level_count);
+            memcpy(table.data(), mapped.data() + sizeof(header), table.size() * sizeof(Level));
+
+            // a damaged file must not send lookups out of bounds
+            for (const auto &level : table)
+            {
+                valid = valid && level.width > 0 && level.height > 0 &&
+                        level.tiles_x == (level.width + TextureTile::SIZE - 1) >> TextureTile::SIZE_LOG2 &&
+                        level.tiles_y == (level.height + TextureTile::SIZE - 1) >> TextureTile::SIZE_LOG2 &&
+                        level.first_tile + static_cast<uint64_t>(level.tiles_x) * level.tiles_y <= header.tile_count;
+            }
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Corrupted texture page file " << page_file << ".\n";
+            mapped.close();
+            return false;
+        }
+
+        width = header.width;
+        height = header.height;
+        levels = std::move(table);
+        tiles = reinterpret_cast<const TextureTile *>(mapped.data() + header.tile_offset);
+        return true;
+    }
+
+    bool LinearImage::writePages(const std::string &file, const std::filesystem::path &page_file)
+    {
+        unsigned char *data = loadPixels(file, width, height);
+        if (!data)
+            return false;
+
+        std::error_code error;
+        std::filesystem::create_directories(page_file.parent_path(), error);
+
+        TexturePageHeader header;
+        header.magic = TEXTURE_PAGE_MAGIC;
+        header.version = TEXTURE_PAGE_VERSION;
+        header.width = width;
+        header.height = height;
+        header.tile_count = layoutLevels();
+        header.level_count = levels.size();
+        header.source_size = getSourceSize(file);
+        header.source_time = getSourceTime(file);
+        header.path_length = file.size();
+        uint64_t table_end = sizeof(header) + levels.size() * sizeof(Level) + file.size();
+        header.tile_offset = (table_end + alignof(TextureTile) - 1) & ~uint64_t(alignof(TextureTile) - 1);
+
+        // write next to the target and rename, a concurrent or later load never sees a half written file
+        std::filesystem::path temp_file = page_file;
+        temp_file += ".tmp";
+        bool written = false;
+        {
+            std::fstream out(temp_file, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            if (out)
+            {
+                static const char padding[alignof(TextureTile)] = {0};
+                out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                out.write(reinterpret_cast<const char *>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(Level)));
+                out.write(file.data(), static_cast<std::streamsize>(file.size()));
+                out.write(padding, static_cast<std::streamsize>(header.tile_offset - table_end));
+
+                // the full level a row of tiles at a time, after which the 8 bit image is no longer needed
+                vector<TextureTile> row(levels[0].tiles_x);
+                for (int tile_row = 0; tile_row < levels[0].tiles_y && out; ++tile_row)
+                {
+                    convertRow(data, tile_row, row.data());
+                    out.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(TextureTile)));
+                }
+                stbi_image_free(data);
+                data = nullptr;
+
+                // every coarser level from the two rows of tiles of the finer one it covers, read back from the file
+                for (size_t i = 1; i < levels.size() && out; ++i)
+                {
+                    const Level &fine = levels[i - 1];
+                    const Level &coarse = levels[i];
+                    vector<TextureTile> fine_rows(2 * static_cast<size_t>(fine.tiles_x));
+                    vector<TextureTile> coarse_row(coarse.tiles_x);
+
+                    for (int tile_row = 0; tile_row < coarse.tiles_y && out; ++tile_row)
+                    {
+                        int first = 2 * tile_row;
+                        int count = std::min(2, fine.tiles_y - first);
+                        out.seekg(static_cast<std::streamoff>(header.tile_offset + (fine.first_tile + static_cast<uint64_t>(first) * fine.tiles_x) * sizeof(TextureTile)));
+                        out.read(reinterpret_cast<char *>(fine_rows.data()), static_cast<std::streamsize>(count * fine.tiles_x * sizeof(TextureTile)));
+
+                        auto fine_texel = [&](int x, int y)
+                        {
+                            x = std::min(x, fine.width - 1);
+                            y = std::min(y, fine.height - 1);
+                            int tile = ((y >> TextureTile::SIZE_LOG2) - first) * fine.tiles_x + (x >> TextureTile::SIZE_LOG2);
+                            return fine_rows[tile].texels[TextureTile::index(x & (TextureTile::SIZE - 1), y & (TextureTile::SIZE - 1))];
+                        };
+                        downsampleRow(coarse, tile_row, fine_texel, coarse_row.data());
+
+                        out.seekp(static_cast<std::streamoff>(header.tile_offset + (coarse.first_tile + static_cast<uint64_t>(tile_row) * coarse.tiles_x) * sizeof(TextureTile)));
+                        out.write(reinterpret_cast<const char *>(coarse_row.data()), static_cast<std::streamsize>(coarse_row.size() * sizeof(TextureTile)));
+                    }
+                }
+                written = static_cast<bool>(out);
+            }
+        }
+        if (data)
+            stbi_image_free(data);
+
+        if (!written)
+        {
+            std::filesystem::remove(temp_file, error);
+            std::cerr << "Failed to write texture page file " << temp_file << ".\n";
+            return false;
+        }
+
+        std::filesystem::rename(temp_file, page_file, error);
+        if (error)
+        {
+            std::filesystem::remove(temp_file, error);
+            return false;
+        }
+        return true;
+    }
+
+    vec3 LinearImage::bilinear(int level, float u, float v) const
+    {
+        const Level &l = levels[level];
+
+        // texel centers sit at half integers, the four around the point are wrapped for repeat tiling. With the
+        // coordinates folded into [0, 1) first, only the left and bottom neighbours can fall off the level.
+        float x = (u - floor(u)) * l.width - 0.5f;
+        float y = (v - floor(v)) * l.height - 0.5f;
+        float fx = floor(x);
+        float fy = floor(y);
+        float tx = x - fx;
+        float ty = y - fy;
+
+        int x0 = static_cast<int>(fx);
+        int y0 = static_cast<int>(fy);
+        int x1 = x0 + 1;
+        int y1 = y0 + 1;
+        if (x0 < 0)
+            x0 = l.width - 1;
+        if (y0 < 0)
+            y0 = l.height - 1;
+        if (x1 >= l.width)
+            x1 = 0;
+        if (y1 >= l.height)
+            y1 = 0;
+
+        // tile rows and columns are split from the Morton bits once, the four texels only combine them
+        const int mask = TextureTile::SIZE - 1;
+        const TextureTile *row0 = tiles + l.first_tile + static_cast<uint64_t>(y0 >> TextureTile::SIZE_LOG2) * l.tiles_x;
+        const TextureTile *row1 = tiles + l.first_tile + static_cast<uint64_t>(y1 >> TextureTile::SIZE_LOG2) * l.tiles_x;
+        int my0 = TextureTile::spread(y0 & mask) << 1;
+        int my1 = TextureTile::spread(y1 & mask) << 1;
+        int tx0 = x0 >> TextureTile::SIZE_LOG2;
+        int tx1 = x1 >> TextureTile::SIZE_LOG2;
+        int mx0 = TextureTile::spread(x0 & mask);
+        int mx1 = TextureTile::spread(x1 & mask);
+
+        vec3 c = (1 - ty) * ((1 - tx) * row0[tx0].texels[my0 | mx0] + tx * row0[tx1].texels[my0 | mx1]) +
+                 ty * ((1 - tx) * row1[tx0].texels[my1 | mx0] + tx * row1[tx1].texels[my1 | mx1]);
+        return c;
+    }
+
+    vec3 LinearImage::value(float u, float v, const vec3 &p) const
+    {
+        // If we have no texture data then fallback to mat.Kd
+        if (!tiles)
+            return vec3(-1, -1, -1);
+
+        return bilinear(0, u, v);
+    }
+
+    vec3 LinearImage::filter(const vec2 &uv, const vec2 &duvdx, const vec2 &duvdy) const
+    {
+        if (!tiles)
+            return vec3(-1, -1, -1);
+
+        // the longer side of the footprint in texels picks the level
+        vec2 size(width, height);
+        float footprint = std::max(length(duvdx * size), length(duvdy * size));
+        if (!(footprint > 1.f))
+            return bilinear(0, uv.s, uv.t);
+
+        float lod = std::min(log2(footprint), static_cast<float>(levels.size() - 1));
+        int level = std::min(static_cast<int>(lod), static_cast<int>(levels.size()) - 2);
+        if (level < 0)
+            return bilinear(0, uv.s, uv.t);
+
+        float t = lod - level;
+        return (1 - t) * bilinear(level, uv.s, uv.t) + t * bilinear(level + 1, uv.s, uv.t);
+    }
+
+    std::filesystem::file_time_type TextureCache::getWriteTime(const std::string &file)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(file, error);
+        return error ? std::filesystem::file_time_type::min() : time;
+    }
+
+    std::filesystem::path TextureCache::getPageFile(const std::string &file, const std::filesystem::path &page_folder)
+    {
+        // the source path, size and time name the page file, so an edited texture gets a new one
+        uint64_t size = getSourceSize(file);
+        int64_t time = getSourceTime(file);
+
+        uint64_t key = hash_bytes(file.data(), file.size(), TEXTURE_PAGE_VERSION);
+        key = hash_bytes(&size, sizeof(size), key);
+        key = hash_bytes(&time, sizeof(time), key);
+
+        char name[32];
+        snprintf(name, sizeof(name), "_%016" PRIx64 ".tex", key);
+        return page_folder / (std::filesystem::path(file).stem().string() + name);
+    }
+
+    void TextureCache::removeStalePages(const std::filesystem::path &page_folder)
+    {
+        std::error_code error;
+        vector<std::filesystem::path> stale;
+        for (std::filesystem::directory_iterator it(page_folder, error), end; !error && it != end; it.increment(error))
+        {
+            const std::filesystem::path &page_file = it->path();
+            if (page_file.extension() == ".tmp" && page_file.stem().extension() == ".tex")
+            {
+                // left over by a write that was cut short
+                stale.push_back(page_file);
+                continue;
+            }
+            if (page_file.extension() != ".tex")
+                continue;
+
+            // an older version or a source that changed or is gone would never be asked for again
+            std::ifstream in(page_file, std::ios::binary);
+            TexturePageHeader header;
+            std::string source;
+            bool current = in.read(reinterpret_cast<char *>(&header), sizeof(header)) && header.magic == TEXTURE_PAGE_MAGIC &&
+                           header.version == TEXTURE_PAGE_VERSION && header.path_length < 65536;
+            if (current)
+            {
+                source.resize(header.path_length);
+                in.seekg(static_cast<std::streamoff>(sizeof(header) + header.level_count * sizeof(LinearImage::Level)));
+                current = in.read(source.data(), static_cast<std::streamsize>(source.size())) &&
+                          header.source_size == getSourceSize(source) && header.source_time == getSourceTime(source) &&
+                          getPageFile(source, page_folder).filename() == page_file.filename();
+            }
+            if (!current)
+                stale.push_back(page_file);
+        }
+
+        for (const auto &page_file : stale)
+            std::filesystem::remove(page_file, error);
+    }
+
+    void TextureCache::load(const vector<std::string> &files, const std::filesystem::path &page_folder)
+    {
+        vector<std::string> missing;
+        vector<std::filesystem::file_time_type> write_times;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!page_folder.empty() && std::find(swept_folders.begin(), swept_folders.end(), page_folder) == swept_folders.end())
+            {
+                removeStalePages(page_folder);
+                swept_folders.push_back(page_folder);
+            }
+
+            for (const auto &file : files)
+            {
+                auto write_time = getWriteTime(file);
+                auto found = entries.find(file);
+                if (found != entries.end() && found->second.write_time == write_time && found->second.page_folder == page_folder)
+                    continue;
+                if (std::find(missing.begin(), missing.end(), file) != missing.end())
+                    continue;
+
+                missing.push_back(file);
+                write_times.push_back(write_time);
+            }
+        }
+
+        vector<shared_ptr<const LinearImage>> images(missing.size());
+        tbb::parallel_for(size_t(0), missing.size(), [&](size_t i)
+                          {
+                              auto page_file = page_folder.empty() ? std::filesystem::path() : getPageFile(missing[i], page_folder);
+                              images[i] = make_shared<LinearImage>(missing[i], page_file); });
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < missing.size(); ++i)
+            entries[missing[i]] = {images[i], write_times[i], page_folder};
+    }
+
+    shared_ptr<const LinearImage> TextureCache::get(const std::string &file) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(file);
+        return found == entries.end() ? nullptr : found->second.image;
+    }
+
+    void TextureCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+}
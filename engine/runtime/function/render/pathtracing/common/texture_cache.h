@@ -0,0 +1,132 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/render_texture.h"
+#include "runtime/platform/file_system/mapped_file.h"
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace MiniEngine::PathTracing
+{
+    // bump whenever the tile layout or the page file header changes
+    const uint32_t TEXTURE_PAGE_VERSION = 2;
+
+    // 8 x 8 texels in Morton order, so the 2 x 2 block of a bilinear lookup is at most two cache lines and a small
+    // footprint stays within one tile whichever direction it moves in. Texels stay unpadded RGB, the lookups are
+    // scalar and an alpha of padding only adds a third more memory traffic.
+    struct alignas(64) TextureTile
+    {
+        static const int SIZE_LOG2 = 3;
+        static const int SIZE = 1 << SIZE_LOG2;
+
+        vec3 texels[SIZE * SIZE];
+
+        // the bits of a coordinate within the tile, spread out to the even bits of the Morton index
+        static int spread(int v)
+        {
+            static const int bits[SIZE] = {0, 1, 4, 5, 16, 17, 20, 21};
+            return bits[v];
+        }
+
+        static int index(int x, int y) { return spread(x) | (spread(y) << 1); }
+    };
+
+    static_assert(sizeof(TextureTile) == 768, "TextureTile should be 12 whole cache lines");
+
+    // An 8 bit image decoded once and converted to linear float texels, so a lookup is a plain load. Rows are
+    // stored bottom up like the flipped images the rasterizer loads. A mip pyramid built at load time lets
+    // lookups with a large footprint read a small level instead of scattered texels of the full image.
+    // All levels live in one array of tiles, either in memory or mapped from a page file that the system reads in
+    // tile by tile as lookups touch it, so texture sets larger than memory can be rendered. A page file is written
+    // a row of tiles at a time, only the 8 bit image is ever held in full while it is made.
+    class LinearImage : public Texture
+    {
+    public:
+        struct Level
+        {
+            int32_t width;
+            int32_t height;
+            int32_t tiles_x;
+            int32_t tiles_y;
+            uint64_t first_tile;
+        };
+
+        int width{0};
+        int height{0};
+        vector<Level> levels;
+
+        // page_file is where the tiles are mapped from, written first if needed, none keeps them in memory
+        LinearImage(const std::string &file, const std::filesystem::path &page_file = {});
+
+        bool isValid() const { return tiles != nullptr; }
+        bool isPaged() const { return mapped.isOpen(); }
+
+        // bilinear at the full resolution with repeat wrapping, negative if the file could not be loaded
+        virtual vec3 value(float u, float v, const vec3 &p) const override;
+        // trilinear over the levels that match the footprint spanned by the two texture space differentials
+        vec3 filter(const vec2 &uv, const vec2 &duvdx, const vec2 &duvdy) const;
+
+    private:
+        vector<TextureTile> resident;
+        MappedFile mapped;
+        const TextureTile *tiles{nullptr};
+
+        // tile and texel within it
+        static std::pair<uint64_t, int> locate(const Level &l, int x, int y)
+        {
+            uint64_t tile = l.first_tile + static_cast<uint64_t>(y >> TextureTile::SIZE_LOG2) * l.tiles_x + (x >> TextureTile::SIZE_LOG2);
+            return {tile, TextureTile::index(x & (TextureTile::SIZE - 1), y & (TextureTile::SIZE - 1))};
+        }
+
+        const vec3 &texel(const Level &l, int x, int y) const
+        {
+            auto at = locate(l, x, y);
+            return tiles[at.first].texels[at.second];
+        }
+
+        vec3 bilinear(int level, float u, float v) const;
+        uint64_t layoutLevels();
+        void convertRow(const unsigned char *data, int tile_row, TextureTile *row) const;
+        template <typename Fetch>
+        static void downsampleRow(const Level &coarse, int tile_row, Fetch fine_texel, TextureTile *row);
+        bool decode(const std::string &file);
+        void buildPyramid();
+        bool mapPages(const std::filesystem::path &page_file);
+        bool writePages(const std::string &file, const std::filesystem::path &page_file);
+    };
+
+    // Images by path, shared by every material and model that uses them and kept between renders. An entry is
+    // decoded again only after its file changed on disk.
+    class TextureCache
+    {
+    public:
+        // decodes the files that are missing or stale, in parallel across files. With a page folder the tiles of
+        // each image go through a page file in it instead of staying in memory, and the first load with a folder
+        // removes the page files in it whose source changed or is gone.
+        void load(const vector<std::string> &files, const std::filesystem::path &page_folder = {});
+        // the image of a file passed to load(), nullptr for any other
+        shared_ptr<const LinearImage> get(const std::string &file) const;
+        void clear();
+
+    private:
+        struct Entry
+        {
+            shared_ptr<const LinearImage> image;
+            std::filesystem::file_time_type write_time;
+            std::filesystem::path page_folder;
+        };
+
+        std::unordered_map<std::string, Entry> entries;
+        mutable std::mutex mutex;
+
+        // page folders already swept of stale files by this cache
+        vector<std::filesystem::path> swept_folders;
+
+        static std::filesystem::file_time_type getWriteTime(const std::string &file);
+        static std::filesystem::path getPageFile(const std::string &file, const std::filesystem::path &page_folder);
+        static void removeStalePages(const std::filesystem::path &page_folder);
+    };
+}
@@ -0,0 +1,191 @@
+#include "runtime/function/render/pathtracing/denoiser.h"
+#include "thirdparty/oidn/include/OpenImageDenoise/oidn.hpp"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    static_assert(sizeof(vec3) == 3 * sizeof(float), "buffers are handed over as packed Float3");
+
+    struct Denoiser::Filters
+    {
+        oidn::DeviceRef device;
+        oidn::FilterRef albedo;
+        oidn::FilterRef normal;
+        oidn::FilterRef color;
+    };
+
+    Denoiser::Denoiser() : filters(make_unique<Filters>())
+    {
+        filters->device = oidn::newDevice();
+        filters->device.commit();
+
+        filters->albedo = filters->device.newFilter("RT");
+        filters->normal = filters->device.newFilter("RT");
+        filters->color = filters->device.newFilter("RT"); // generic ray tracing filter
+        filters->color.set("hdr", true);
+        // the guides are prefiltered, so the color pass can take them as exact
+        filters->color.set("cleanAux", true);
+
+        worker = std::thread(&Denoiser::run, this);
+    }
+
+    Denoiser::~Denoiser()
+    {
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            quit = true;
+        }
+        job_signal.notify_all();
+        worker.join();
+    }
+
+    void Denoiser::resize(int new_width, int new_height)
+    {
+        if (new_width == width && new_height == height)
+            return;
+
+        width = new_width;
+        height = new_height;
+        size_t count = static_cast<size_t>(width) * height;
+        color.resize(count);
+        albedo.resize(count);
+        normal.resize(count);
+
+        // the guides are filtered in place, the color pass reads them and overwrites the color
+        auto *color_buffer = reinterpret_cast<float *>(color.data());
+        auto *albedo_buffer = reinterpret_cast<float *>(albedo.data());
+        auto *normal_buffer = reinterpret_cast<float *>(normal.data());
+
+        filters->albedo.setImage("albedo", albedo_buffer, oidn::Format::Float3, width, height);
+        filters->albedo.setImage("output", albedo_buffer, oidn::Format::Float3, width, height);
+        filters->albedo.commit();
+
+        filters->normal.setImage("normal", normal_buffer, oidn::Format::Float3, width, height);
+        filters->normal.setImage("output", normal_buffer, oidn::Format::Float3, width, height);
+        filters->normal.commit();
+
+        filters->color.setImage("color", color_buffer, oidn::Format::Float3, width, height);   // beauty
+        filters->color.setImage("albedo", albedo_buffer, oidn::Format::Float3, width, height); // auxiliary
+        filters->color.setImage("normal", normal_buffer, oidn::Format::Float3, width, height); // auxiliary
+        filters->color.setImage("output", color_buffer, oidn::Format::Float3, width, height);  // denoised beauty
+        filters->color.commit();
+    }
+
+    void Denoiser::copyIn(const vec3 *color_in, const vec3 *albedo_in, const vec3 *normal_in, int new_width, int new_height)
+    {
+        resize(new_width, new_height);
+        size_t count = static_cast<size_t>(width) * height;
+        std::copy(color_in, color_in + count, color.begin());
+        std::copy(albedo_in, albedo_in + count, albedo.begin());
+        std::copy(normal_in, normal_in + count, normal.begin());
+    }
+
+    void Denoiser::execute()
+    {
+        filters->albedo.execute();
+        filters->normal.execute();
+        filters->color.execute();
+
+        // Check for errors
+        const char *errorMessage;
+        if (filters->device.getError(errorMessage) != oidn::Error::None)
+            std::cout << "Error: " << errorMessage << std::endl;
+    }
+
+    void Denoiser::denoise(vec3 *color_io, const vec3 *albedo_in, const vec3 *normal_in, int new_width, int new_height)
+    {
+        {
+            // a preview of the same render is outdated by the final image
+            std::unique_lock<std::mutex> lock(job_mutex);
+            done_signal.wait(lock, [this]()
+                             { return !job_pending && !job_running; });
+            result_ready = false;
+        }
+
+        std::lock_guard<std::mutex> lock(filter_mutex);
+        copyIn(color_io, albedo_in, normal_in, new_width, new_height);
+        execute();
+        std::copy(color.begin(), color.end(), color_io);
+    }
+
+    bool Denoiser::denoiseAsync(const vec3 *color_in, const vec3 *albedo_in, const vec3 *normal_in, int new_width, int new_height, int tag)
+    {
+        if (isBusy())
+            return false;
+
+        // the worker is idle, so the copy cannot race with it
+        {
+            std::lock_guard<std::mutex> lock(filter_mutex);
+            copyIn(color_in, albedo_in, normal_in, new_width, new_height);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            job_pending = true;
+            job_tag = tag;
+        }
+        job_signal.notify_one();
+        return true;
+    }
+
+    bool Denoiser::fetch(vector<vec3> &output, int &tag)
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        if (!result_ready)
+            return false;
+
+        output.swap(result);
+        tag = job_tag;
+        result_ready = false;
+        return true;
+    }
+
+    bool Denoiser::isBusy() const
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        return job_pending || job_running;
+    }
+
+    void Denoiser::discard()
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        job_pending = false;
+        result_ready = false;
+        result.clear();
+        ++generation;
+    }
+
+    void Denoiser::run()
+    {
+        std::unique_lock<std::mutex> lock(job_mutex);
+        while (true)
+        {
+            job_signal.wait(lock, [this]()
+                            { return quit || job_pending; });
+            if (quit)
+                return;
+
+            job_pending = false;
+            job_running = true;
+            int job_generation = generation;
+            lock.unlock();
+
+            vector<vec3> output;
+            {
+                std::lock_guard<std::mutex> filter_lock(filter_mutex);
+                execute();
+                output = color;
+            }
+
+            lock.lock();
+            if (job_generation == generation)
+            {
+                result.swap(output);
+                result_ready = true;
+            }
+            job_running = false;
+            done_signal.notify_all();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace MiniEngine::PathTracing
+{
+    enum class DenoiseFilterType : int
+    {
+        OIDN = 0,   // Open Image Denoise, best quality, takes seconds for a large image
+        ATROUS = 1, // edge-aware à-trous wavelet filter, fast enough for every preview
+    };
+
+    // Open Image Denoise with the device and filters kept across renders. The filters read from and write to
+    // buffers owned by the denoiser, so they are committed again only when the image size changes. Images are
+    // linear HDR color with albedo and normal guides, which are prefiltered before the color pass.
+    // Besides denoising in place, a copy of a partial image can be handed to a background thread while tracing
+    // continues, and its result picked up once it is ready.
+    class Denoiser
+    {
+    public:
+        Denoiser();
+        ~Denoiser();
+
+        Denoiser(const Denoiser &) = delete;
+        Denoiser &operator=(const Denoiser &) = delete;
+
+        // filters color in place, after waiting for a background job whose result is then dropped
+        void denoise(vec3 *color, const vec3 *albedo, const vec3 *normal, int width, int height);
+
+        // copies the images and filters them on the worker, false without copying if the last job is not done.
+        // tag comes back with the result to tell what the snapshot covered.
+        bool denoiseAsync(const vec3 *color, const vec3 *albedo, const vec3 *normal, int width, int height, int tag);
+        // moves out the result of the last background job if it finished since the last call
+        bool fetch(vector<vec3> &output, int &tag);
+        bool isBusy() const;
+        // drops a job that has not started and the result of any job queued before, so a new render starts clean
+        void discard();
+
+    private:
+        struct Filters;
+        unique_ptr<Filters> filters;
+
+        vector<vec3> color;
+        vector<vec3> albedo;
+        vector<vec3> normal;
+        int width{0};
+        int height{0};
+        // held while the buffers above are filled or filtered
+        std::mutex filter_mutex;
+
+        std::thread worker;
+        mutable std::mutex job_mutex;
+        std::condition_variable job_signal;
+        std::condition_variable done_signal;
+        bool job_pending{false};
+        bool job_running{false};
+        bool result_ready{false};
+        bool quit{false};
+        int job_tag{0};
+        // bumped by discard(), a job started under an older one finishes without a result
+        int generation{0};
+        vector<vec3> result;
+
+        void resize(int width, int height);
+        void copyIn(const vec3 *color, const vec3 *albedo, const vec3 *normal, int width, int height);
+        void execute();
+        void run();
+    };
+}
@@ -0,0 +1,196 @@
+#include "runtime/function/render/pathtracing/image_writer.h"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace MiniEngine::PathTracing
+{
+    ImageWriter::ImageWriter()
+    {
+        worker = std::thread(&ImageWriter::run, this);
+    }
+
+    ImageWriter::~ImageWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            quit = true;
+        }
+        job_signal.notify_all();
+        worker.join();
+    }
+
+    const char *ImageWriter::getExtension(ImageFormatType format)
+    {
+        switch (format)
+        {
+        case ImageFormatType::HDR:
+            return ".hdr";
+        case ImageFormatType::QOI:
+            return ".qoi";
+        default:
+            return ".png";
+        }
+    }
+
+    void ImageWriter::write(std::filesystem::path path, ImageFormatType format, int width, int height,
+                            const unsigned char *pixels, const vec3 *radiance)
+    {
+        Job job;
+        job.path = path.replace_extension(getExtension(format));
+        job.format = format;
+        job.width = width;
+        job.height = height;
+
+        // copied before waiting for room in the queue, so the caller's buffers are free as soon as this returns
+        if (format == ImageFormatType::HDR)
+        {
+            size_t row = 3 * static_cast<size_t>(width);
+            job.radiance.resize(row * height);
+            const float *source = reinterpret_cast<const float *>(radiance);
+            for (int y = 0; y < height; ++y)
+                std::copy(source + (height - 1 - y) * row, source + (height - y) * row, job.radiance.begin() + y * row);
+        }
+        else
+        {
+            size_t row = 3 * static_cast<size_t>(width);
+            job.pixels.resize(row * height);
+            for (int y = 0; y < height; ++y)
+                std::copy(pixels + (height - 1 - y) * row, pixels + (height - y) * row, job.pixels.begin() + y * row);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            done_signal.wait(lock, [this]()
+                             { return jobs.size() < MAX_QUEUED; });
+            jobs.push_back(std::move(job));
+        }
+        job_signal.notify_one();
+    }
+
+    void ImageWriter::flush()
+    {
+        std::unique_lock<std::mutex> lock(job_mutex);
+        done_signal.wait(lock, [this]()
+                         { return jobs.empty() && !job_running; });
+    }
+
+    void ImageWriter::run()
+    {
+        std::unique_lock<std::mutex> lock(job_mutex);
+        while (true)
+        {
+            // the queue is emptied before quitting, nothing asked for is lost
+            job_signal.wait(lock, [this]()
+                            { return quit || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            job_running = true;
+            lock.unlock();
+            done_signal.notify_all();
+
+            if (!encode(job))
+                std::cerr << "Failed to write image " << job.path << std::endl;
+
+            lock.lock();
+            job_running = false;
+            done_signal.notify_all();
+        }
+    }
+
+    bool ImageWriter::encode(const Job &job)
+    {
+        std::string file = job.path.string();
+        switch (job.format)
+        {
+        case ImageFormatType::HDR:
+            return stbi_write_hdr(file.c_str(), job.width, job.height, 3, job.radiance.data()) != 0;
+        case ImageFormatType::QOI:
+            return writeQOI(job);
+        default:
+            return stbi_write_png(file.c_str(), job.width, job.height, 3, job.pixels.data(), 0) != 0;
+        }
+    }
+
+    // The Quite OK Image format, https://qoiformat.org/qoi-specification.pdf. Every pixel is a run of the one
+    // before, a slot in a hash of recent colors, a small difference to the one before or the color itself.
+    bool ImageWriter::writeQOI(const Job &job)
+    {
+        static const unsigned char OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xc0, OP_RGB = 0xfe;
+
+        vector<unsigned char> bytes;
+        bytes.reserve(14 + job.pixels.size() + job.pixels.size() / 3 + 8);
+        auto put32 = [&bytes](uint32_t value)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+                bytes.push_back(static_cast<unsigned char>(value >> shift));
+        };
+
+        bytes.insert(bytes.end(), {'q', 'o', 'i', 'f'});
+        put32(static_cast<uint32_t>(job.width));
+        put32(static_cast<uint32_t>(job.height));
+        bytes.push_back(3); // RGB
+        bytes.push_back(0); // sRGB
+
+        // alpha is always 255, so it drops out of the differences. The hash table keeps it, an empty slot is
+        // transparent black to the decoder as well and must not stand in for opaque black.
+        unsigned char seen[64][4] = {};
+        unsigned char previous[3] = {0, 0, 0};
+        int run = 0;
+        size_t count = static_cast<size_t>(job.width) * job.height;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned char *px = job.pixels.data() + 3 * i;
+            if (px[0] == previous[0] && px[1] == previous[1] && px[2] == previous[2])
+            {
+                if (++run == 62 || i + 1 == count)
+                {
+                    bytes.push_back(OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                bytes.push_back(OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            const unsigned char rgba[4] = {px[0], px[1], px[2], 255};
+            int slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+            if (std::memcmp(seen[slot], rgba, 4) == 0)
+                bytes.push_back(OP_INDEX | slot);
+            else
+            {
+                std::memcpy(seen[slot], rgba, 4);
+
+                int dr = static_cast<signed char>(px[0] - previous[0]);
+                int dg = static_cast<signed char>(px[1] - previous[1]);
+                int db = static_cast<signed char>(px[2] - previous[2]);
+                int dr_dg = dr - dg, db_dg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    bytes.push_back(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    bytes.push_back(OP_LUMA | (dg + 32));
+                    bytes.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+                }
+                else
+                    bytes.insert(bytes.end(), {OP_RGB, px[0], px[1], px[2]});
+            }
+            std::memcpy(previous, px, 3);
+        }
+        bytes.insert(bytes.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+        std::ofstream out(job.path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        return out.good();
+    }
+}
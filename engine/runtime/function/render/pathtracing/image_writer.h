@@ -0,0 +1,65 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace MiniEngine::PathTracing
+{
+    enum class ImageFormatType : int
+    {
+        PNG = 0, // 8 bit, smallest files, seconds to compress a 4K frame
+        HDR = 1, // Radiance RGBE of the linear radiance, before exposure and tone mapping, for compositing
+        QOI = 2, // 8 bit lossless, tens of times faster to write than PNG, for sequences
+    };
+
+    // Writes rendered images on a background thread, so the renderer can go on with the next frame. Images are
+    // copied when queued, flipped to the top row first that files expect, and at most MAX_QUEUED wait at a time.
+    class ImageWriter
+    {
+    public:
+        ImageWriter();
+        ~ImageWriter(); // finishes the queued images first
+
+        ImageWriter(const ImageWriter &) = delete;
+        ImageWriter &operator=(const ImageWriter &) = delete;
+
+        // queues the image in the given format, the extension of path is changed to match it.
+        // pixels are the bottom row first 8 bit RGB, radiance the linear color in the same layout.
+        void write(std::filesystem::path path, ImageFormatType format, int width, int height,
+                   const unsigned char *pixels, const vec3 *radiance);
+        // returns once everything queued so far is on disk
+        void flush();
+
+        static const char *getExtension(ImageFormatType format);
+
+    private:
+        static const size_t MAX_QUEUED = 4;
+
+        struct Job
+        {
+            std::filesystem::path path;
+            ImageFormatType format;
+            int width;
+            int height;
+            vector<unsigned char> pixels;
+            vector<float> radiance;
+        };
+
+        std::thread worker;
+        std::mutex job_mutex;
+        std::condition_variable job_signal;
+        std::condition_variable done_signal;
+        std::deque<Job> jobs;
+        bool job_running{false};
+        bool quit{false};
+
+        void run();
+        static bool encode(const Job &job);
+        static bool writeQOI(const Job &job);
+    };
+}
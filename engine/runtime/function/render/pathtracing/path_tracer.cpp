@@ -4,11 +4,13 @@
 #include "runtime/function/render/pathtracing/primitive/sphere.h"
 #include "runtime/function/render/pathtracing/primitive/rectangle.h"
 #include "runtime/function/render/pathtracing/primitive/box.h"
+#include "runtime/function/render/pathtracing/primitive/primitive_set.h"
 #include "runtime/function/render/pathtracing/primitive/triangle.h"
+#include "runtime/function/render/pathtracing/primitive/instance.h"
+#include "runtime/function/render/pathtracing/primitive/environment_light.h"
 #include "runtime/function/render/pathtracing/common/camera.h"
 #include "runtime/function/render/pathtracing/common/material.h"
 #include "runtime/function/render/pathtracing/common/pdf.h"
-#include "thirdparty/oidn/include/OpenImageDenoise/oidn.hpp"
 #include "thirdparty/tbb/include/tbb/parallel_for.h"
 
 #define MaxLights 8
@@ -21,11 +23,26 @@ namespace MiniEngine::PathTracing
         init_info->BounceLimit = 4;
         init_info->ImportSample = true;
         init_info->BVH = true;
+        init_info->BVHBuilder = static_cast<int>(BVHBuilderType::SAH);
+        init_info->Restructure = true;
+        init_info->SplitBudget = 0.5f;
+        init_info->CacheBVH = true;
+        init_info->CompressBVH = false;
+        init_info->PageTextures = false;
         init_info->Denoise = true;
+        init_info->DenoiseFilter = static_cast<int>(DenoiseFilterType::OIDN);
+        init_info->DenoisePreview = true;
         init_info->MultiThread = true;
+        init_info->Exposure = 0.f;
+        init_info->ToneMapper = static_cast<int>(ToneMapperType::NONE);
+        init_info->Dither = false;
         init_info->Output = false;
+        init_info->OutputFormat = static_cast<int>(ImageFormatType::PNG);
+        init_info->Sequence = false;
+        init_info->FrameRate = 24.f;
         init_info->Resolution = glm::ivec2(1280, 720);
         init_info->SampleCount = 128;
+        init_info->EnvironmentIntensity = 1.f;
     }
 
     void PathTracer::initializeRenderer()
@@ -40,6 +57,10 @@ namespace MiniEngine::PathTracing
         }
         pixels = new unsigned char[3 * width * height];
         memset(pixels, 0, sizeof(char) * width * height * 3);
+        radiance.assign(static_cast<size_t>(width) * height, vec3(0, 0, 0));
+        albedo.assign(static_cast<size_t>(width) * height, vec3(0, 0, 0));
+        normal.assign(static_cast<size_t>(width) * height, vec3(0, 0, 0));
+        depth.assign(static_cast<size_t>(width) * height, 0.f);
 
         if (result)
         {
@@ -56,7 +77,7 @@ namespace MiniEngine::PathTracing
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
     }
 
-    vec3 PathTracer::getColor(const Ray &r, const Hittable &mesh, shared_ptr<HittableList> &lights, int depth, bool importance_sampling)
+    vec3 PathTracer::getColor(const Ray &r, const Hittable &mesh, shared_ptr<HittableList> &lights, int depth, bool importance_sampling, SampleFeatures *features)
     {
         HitRecord rec;
 
@@ -67,20 +88,45 @@ namespace MiniEngine::PathTracing
 
         if (!mesh.hit(r, EPS, INF, rec))
         {
-            return vec3(0, 0, 0);
+            vec3 background = environment ? environment->getRadiance(r.direction) : vec3(0, 0, 0);
+            if (features)
+                features->albedo = glm::clamp(background, 0.f, 1.f);
+            return background;
         }
+        rec.resolve(r);
 
         ScatterRecord srec;
         vec3 emitted = rec.mat_ptr->emitted(r, rec);
 
         if (!rec.mat_ptr->scatter(r, rec, srec))
         {
+            if (features)
+            {
+                features->albedo = glm::clamp(emitted, 0.f, 1.f);
+                features->normal = rec.hit_point.Normal;
+                features->depth = rec.t;
+            }
             return emitted;
         }
 
+        // mirrors and glass pass the features of what they show on, tinted by their color
         if (srec.is_specular)
         {
-            return srec.attenuation * getColor(srec.specular_ray, mesh, lights, depth - 1, importance_sampling);
+            vec3 color = srec.attenuation * getColor(srec.specular_ray, mesh, lights, depth - 1, importance_sampling, features);
+            if (features)
+            {
+                features->albedo *= glm::clamp(srec.attenuation, 0.f, 1.f);
+                if (features->depth > 0)
+                    features->depth += rec.t;
+            }
+            return color;
+        }
+
+        if (features)
+        {
+            features->albedo = glm::clamp(rec.mat_ptr->getAlbedo(rec), 0.f, 1.f);
+            features->normal = rec.hit_point.Normal;
+            features->depth = rec.t;
         }
 
         Ray scattered;
@@ -99,15 +145,27 @@ namespace MiniEngine::PathTracing
             pdf = srec.pdf_ptr->value(scattered.direction);
         }
 
-        return emitted + srec.attenuation * rec.mat_ptr->scatterPDF(r, rec, scattered) * getColor(scattered, mesh, lights, depth - 1, importance_sampling) / pdf;
+        // a glossy sample can leave below the surface, where neither the lobe nor the lights have any density
+        if (pdf <= 0)
+        {
+            return emitted;
+        }
+
+        return emitted + rec.mat_ptr->evalScatter(r, rec, srec, scattered) * getColor(scattered, mesh, lights, depth - 1, importance_sampling) / pdf;
     }
 
-    void PathTracer::startTracing(shared_ptr<Model> m_model, shared_ptr<MiniEngine::Camera> m_camera)
+    void PathTracer::startTracing(vector<ModelInstance> instances, shared_ptr<MiniEngine::Camera> m_camera)
     {
         state = 0;
         std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-        transferModelData(m_model);
+        // instances that only moved since the last render keep the scene and refit its top level
+        instances.erase(std::remove_if(instances.begin(), instances.end(), [](const ModelInstance &instance)
+                                       { return !instance.model; }),
+                        instances.end());
+        bvh_refitted = refitScene(instances);
+        if (!bvh_refitted)
+            transferModelData(instances);
 
         // Image
         const int samples = init_info->SampleCount;
@@ -115,22 +173,18 @@ namespace MiniEngine::PathTracing
         const bool importance_sampling = init_info->ImportSample;
 
         // Light
+        loadEnvironment();
         if (!getMainLightNumber()){
             return;
         }
         auto lights = make_shared<HittableList>(light_data);
+        if (environment)
+            lights->add(environment);
 
         // Model
-        HittableList mesh;
-        if (init_info->BVH)
-        {
-            state = 1;
-            mesh.add(make_shared<BVH>(mesh_data));
-        }
-        else
-        {
-            mesh = mesh_data;
-        }
+        if (!bvh_refitted)
+            buildScene();
+        const HittableList &mesh = scene;
 
         // Camera
         vec3 direction(cos(glm::radians(m_camera->Yaw))*cos(glm::radians(m_camera->Pitch)),sin(glm::radians(m_camera->Pitch)),sin(glm::radians(m_camera->Yaw))*cos(glm::radians(m_camera->Pitch)));
@@ -158,6 +212,25 @@ namespace MiniEngine::PathTracing
 
         Camera cam(lookfrom, lookat, vup, fov, aperture, dist_to_focus, aspect_ratio);
 
+        // camera rays carry differentials one pixel apart, narrowed as more samples share the pixel
+        const vec2 pixel_size(1.f / (width - 1), 1.f / (height - 1));
+        const float footprint_scale = std::max(0.125f, 1.f / std::sqrt(static_cast<float>(samples)));
+
+        // the settings are read once, the editor may change them while this render runs
+        const bool denoise = init_info->Denoise;
+        const bool edge_aware = init_info->DenoiseFilter == static_cast<int>(DenoiseFilterType::ATROUS);
+        if (denoise && !edge_aware && !denoiser)
+            denoiser = make_shared<Denoiser>();
+        // a job left running by a stopped render must not show up in this one
+        if (denoiser)
+            denoiser->discard();
+        const bool denoise_preview = denoise && init_info->DenoisePreview;
+        post_process.exposure = init_info->Exposure;
+        post_process.tone_mapper = static_cast<ToneMapperType>(init_info->ToneMapper);
+        post_process.dither = init_info->Dither;
+        last_preview = std::chrono::steady_clock::now();
+        preview_cost = std::chrono::steady_clock::duration::zero();
+
         state = 2;
         // Render
         for (int j = height - 1; j >= 0; --j)
@@ -168,9 +241,10 @@ namespace MiniEngine::PathTracing
             {
                 // multi thread
                 tbb::parallel_for(0, width,
-                                [this, j, samples, max_depth, importance_sampling , &cam, &mesh, &lights](int i)
+                                [this, j, samples, max_depth, importance_sampling, pixel_size, footprint_scale, &cam, &mesh, &lights](int i)
                                 {
                     vec3 pixel_color(0, 0, 0);
+                    SampleFeatures pixel_features;
                     for (int s = 0; s < samples; ++s)
                     {
                         if (should_stop_tracing)
@@ -178,14 +252,22 @@ namespace MiniEngine::PathTracing
 
                         f32 u = (i + linearRand(0.f, 1.f)) / (width - 1);
                         f32 v = (j + linearRand(0.f, 1.f)) / (height - 1);
-                        Ray r = cam.getRay(u, v);
-                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling);
+                        Ray r = cam.getRay(u, v, pixel_size.s, pixel_size.t);
+                        r.scaleDifferentials(footprint_scale);
+                        SampleFeatures features;
+                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling, &features);
                         if (isInfinity(sample_color) || isNan(sample_color))
                             sample_color={0,0,0};
                         pixel_color += sample_color;
+                        pixel_features.albedo += features.albedo;
+                        pixel_features.normal += features.normal;
+                        pixel_features.depth += features.depth;
                     }
                     pixel_color *= 1.0 / samples;
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), pixel_color, 2.2); });
+                    radiance[static_cast<size_t>(j) * width + i] = pixel_color;
+                    albedo[static_cast<size_t>(j) * width + i] = pixel_features.albedo / float(samples);
+                    normal[static_cast<size_t>(j) * width + i] = pixel_features.normal / float(samples);
+                    depth[static_cast<size_t>(j) * width + i] = pixel_features.depth / float(samples); });
                 if (should_stop_tracing)
                     return;
             }
@@ -195,6 +277,7 @@ namespace MiniEngine::PathTracing
                 for (int i = 0; i < width; ++i)
                 {
                     vec3 pixel_color(0, 0, 0);
+                    SampleFeatures pixel_features;
                     for (int s = 0; s < samples; ++s)
                     {
                         if (should_stop_tracing)
@@ -202,148 +285,395 @@ namespace MiniEngine::PathTracing
 
                         f32 u = (i + linearRand(0.f, 1.f)) / (width - 1);
                         f32 v = (j + linearRand(0.f, 1.f)) / (height - 1);
-                        Ray r = cam.getRay(u, v);
-                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling);
+                        Ray r = cam.getRay(u, v, pixel_size.s, pixel_size.t);
+                        r.scaleDifferentials(footprint_scale);
+                        SampleFeatures features;
+                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling, &features);
                         if (isInfinity(sample_color) || isNan(sample_color))
                             sample_color={0,0,0};
                         pixel_color += sample_color;
+                        pixel_features.albedo += features.albedo;
+                        pixel_features.normal += features.normal;
+                        pixel_features.depth += features.depth;
                     }
                     pixel_color *= 1.0 / samples;
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), pixel_color, 2.2);
+                    radiance[static_cast<size_t>(j) * width + i] = pixel_color;
+                    albedo[static_cast<size_t>(j) * width + i] = pixel_features.albedo / float(samples);
+                    normal[static_cast<size_t>(j) * width + i] = pixel_features.normal / float(samples);
+                    depth[static_cast<size_t>(j) * width + i] = pixel_features.depth / float(samples);
                 }
             }
+            tonemap(radiance, j, j + 1);
+
+            // rows j and above are final
+            if (denoise_preview)
+                updatePreview(j, edge_aware);
         }
 
 
-        if (init_info->Denoise)
+        // the preview written while tracing already shows the undenoised radiance
+        if (denoise)
         {
             state = 3;
-            // Denoise
-            float *denoise_buffer = new float[3 * width * height];
+            if (edge_aware)
+            {
+                preview.resize(radiance.size());
+                atrous.apply(radiance.data(), albedo.data(), normal.data(), depth.data(), width, height, preview.data());
+                radiance.swap(preview);
+            }
+            else
+                denoiser->denoise(radiance.data(), albedo.data(), normal.data(), width, height);
+            tonemap(radiance, 0, height);
+        }
 
-            for (int j = height - 1; j >= 0; --j)
+        if (init_info->Output)
+        {
+            // frames of a sequence are numbered, image.png becomes image_0001.png
+            std::filesystem::path file = init_info->SavePath;
+            if (in_sequence)
             {
-                for (int i = 0; i < width; ++i)
-                {
-                    vec3 swap_color = readColor(pixels, ivec2(width, height), ivec2(i, j), 2.2);
-                    denoise_buffer[3 * (width * j + i) + 0] = swap_color.x;
-                    denoise_buffer[3 * (width * j + i) + 1] = swap_color.y;
-                    denoise_buffer[3 * (width * j + i) + 2] = swap_color.z;
-                }
+                char number[16];
+                snprintf(number, sizeof(number), "_%04d", frame + 1);
+                file.replace_filename(file.stem().string() + number + file.extension().string());
             }
 
-            // Create an Intel Open Image Denoise device
-            oidn::DeviceRef device = oidn::newDevice();
-            device.commit();
+            // written in the background, a sequence traces the next frame meanwhile
+            if (!writer)
+                writer = make_shared<ImageWriter>();
+            writer->write(file, static_cast<ImageFormatType>(init_info->OutputFormat), width, height, pixels, radiance.data());
+        }
+
+        state = 4;
+
+        std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+        std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime);
+        render_time = time_span.count();
+
+    }
+
+    void PathTracer::startSequence(vector<ModelInstance> instances, shared_ptr<MiniEngine::Camera> m_camera, CameraPath path)
+    {
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        // the path moves the camera and sets its lens, everything else stays as the editor camera has it. The focus
+        // mode is kept too, in autofocus every frame focuses on what is at the centre and the keyframed distance is unused.
+        auto frame_camera = make_shared<MiniEngine::Camera>(*m_camera);
+        const float frame_rate = std::max(init_info->FrameRate, 1e-3f);
+        frame_count = static_cast<int>(std::floor(path.getDuration() * frame_rate + 1e-3f)) + 1;
+        in_sequence = true;
+
+        for (frame = 0; frame < frame_count; ++frame)
+        {
+            CameraKeyframe keyframe = path.evaluate(frame / frame_rate);
+            frame_camera->Position = keyframe.position;
+            frame_camera->Yaw = keyframe.yaw;
+            frame_camera->Pitch = keyframe.pitch;
+            frame_camera->Zoom = keyframe.fov;
+            frame_camera->Aperture = keyframe.aperture;
+            frame_camera->FocusDistance = keyframe.focus_distance;
+            frame_camera->updateCameraVectors();
+
+            // the scene, textures and BVHs stay resident, frames after the first only refit the unchanged scene
+            startTracing(instances, frame_camera);
+            if (should_stop_tracing || state != 4)
+                break;
+        }
+        frame = std::min(frame, frame_count - 1);
+
+        // the sequence is done once its last frame is on disk
+        if (writer)
+            writer->flush();
+
+        std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+        render_time = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime).count();
+        in_sequence = false;
+    }
+
+    void PathTracer::updatePreview(int first_row, bool edge_aware)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        // the edge-aware filter is cheap enough to run on the finished rows right here
+        if (edge_aware)
+        {
+            // it holds up tracing, so waiting four times as long as it took keeps it to a fifth of the time
+            auto interval = std::max<std::chrono::steady_clock::duration>(std::chrono::milliseconds(FILTER_PREVIEW_INTERVAL), 4 * preview_cost);
+            if (now - last_preview < interval)
+                return;
+            preview.resize(radiance.size());
+            atrous.apply(radiance.data(), albedo.data(), normal.data(), depth.data(), width, height, preview.data(), first_row);
+            tonemap(preview, first_row, height);
+            last_preview = std::chrono::steady_clock::now();
+            preview_cost = last_preview - now;
+            return;
+        }
+
+        // show what the last background job made of the rows that were done when it started
+        int done_row;
+        if (denoiser->fetch(preview, done_row) && preview.size() == radiance.size())
+            tonemap(preview, done_row, height);
+
+        if (now - last_preview >= std::chrono::milliseconds(PREVIEW_INTERVAL) &&
+            denoiser->denoiseAsync(radiance.data(), albedo.data(), normal.data(), width, height, first_row))
+            last_preview = now;
+    }
+
+    void PathTracer::tonemap(const vector<vec3> &source, int first_row, int end_row)
+    {
+        // the one pass from the HDR estimate to the 8 bit display and output image
+        post_process.apply(source.data(), pixels, width, first_row, end_row);
+    }
 
-            // Create a filter for denoising a beauty (color) image using optional auxiliary images too
-            oidn::FilterRef filter = device.newFilter("RT");                           // generic ray tracing filter
-            filter.setImage("color", denoise_buffer, oidn::Format::Float3, width, height);  // beauty
-            filter.setImage("output", denoise_buffer, oidn::Format::Float3, width, height); // denoised beauty
-            filter.set("hdr", false);
-            filter.commit();
+    BVHBuildSettings PathTracer::getBuildSettings() const
+    {
+        BVHBuildSettings settings;
+        settings.builder = static_cast<BVHBuilderType>(init_info->BVHBuilder);
+        settings.restructure = init_info->Restructure;
+        settings.split_budget = init_info->SplitBudget;
+        return settings;
+    }
 
-            // Filter the image
-            filter.execute();
+    void PathTracer::packTriangles(shared_ptr<Model> m_model, ModelData &data)
+    {
+        size_t triangle_count = 0;
+        for (const auto &mesh : m_model->meshes)
+            triangle_count += mesh.indices.size() / 3;
 
-            // Check for errors
-            const char *errorMessage;
-            if (device.getError(errorMessage) != oidn::Error::None)
-                std::cout << "Error: " << errorMessage << std::endl;
+        data.packed.clear();
+        data.packed.reserve(triangle_count);
 
-            for (int j = height - 1; j >= 0; --j)
+        for (uint32_t mesh_id = 0; mesh_id < m_model->meshes.size(); ++mesh_id)
+        {
+            const auto &mesh = m_model->meshes[mesh_id];
+            for (size_t id = 0; id + 2 < mesh.indices.size(); id += 3)
             {
-                for (int i = 0; i < width; ++i)
+                PackedTriangle triangle;
+                for (int k = 0; k < 3; ++k)
                 {
-                    vec3 swap_color;
-                    swap_color.x = denoise_buffer[3 * (width * j + i) + 0];
-                    swap_color.y = denoise_buffer[3 * (width * j + i) + 1];
-                    swap_color.z = denoise_buffer[3 * (width * j + i) + 2];
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), swap_color, 2.2);
+                    const Vertex &vertex = mesh.vertices[mesh.indices[id + k]];
+                    triangle.position[k] = vertex.Position;
+                    triangle.texcoord[k] = vertex.Texcoord;
                 }
+                triangle.mesh = mesh_id;
+                data.packed.push_back(triangle);
             }
-
-            free(denoise_buffer);
         }
+    }
 
-        if (init_info->Output)
+    void PathTracer::transferModel(shared_ptr<Model> m_model, ModelData &data)
+    {
+        // an unchanged model rendered with the same settings takes its triangles and BVH from the cache
+        data.cache_valid = init_info->BVH && init_info->CacheBVH && BVHCache::getKey(*m_model, getBuildSettings(), data.cache_key);
+        if (data.cache_valid)
         {
-            // unsigned char *output_buffer = new unsigned char[3 * width * height];
+            data.cache_file = BVHCache::getCacheFile(*m_model, data.cache_key);
+            data.bvh_cached = BVHCache::load(data.cache_file, data.cache_key, data.packed, data.cached_nodes, data.cached_prim_indices);
+        }
+        if (!data.bvh_cached)
+            packTriangles(m_model, data);
 
-            // for (int j = height - 1; j >= 0; --j)
-            // {
-            //     for (int i = 0; i < width; ++i)
-            //     {
-            //         vec3 srgb_color = readColor(pixels, ivec2(width, height), ivec2(i, j), 1.0);
-            //         writeColor(output_buffer, ivec2(width, height), ivec2(i, j), srgb_color, 2.2);
-            //     }
-            // }
+        // one material per mesh, so the mesh index of a triangle is its material id
+        data.materials = make_shared<MaterialTable>();
+        for (const auto &mesh : m_model->meshes)
+            data.materials->add(mesh.material, m_model->model_path, textures);
 
-            stbi_flip_vertically_on_write(true);
-            stbi_write_png(init_info->SavePath, width, height, 3, pixels, 0);
+        // loop triangles
+        data.primitives = make_shared<PrimitiveSet>();
+        data.primitives->triangles.reserve(data.packed.size());
+        for (const auto &triangle : data.packed)
+        {
+            std::array<Vertex, 3> vertices{};
+            for (int k = 0; k < 3; ++k)
+            {
+                vertices[k].Position = triangle.position[k];
+                vertices[k].Texcoord = triangle.texcoord[k];
+            }
+
+            data.primitives->add(Triangle(vertices, data.materials.get(), triangle.mesh));
 
-            // free(output_buffer);
+            if (data.materials->isEmissive(triangle.mesh))
+            {
+                data.emitters.push_back(make_shared<Triangle>(vertices, nullptr));
+            }
         }
+    }
 
-        state = 4;
+    float PathTracer::buildModelBVH(ModelData &data)
+    {
+        std::chrono::steady_clock::time_point buildStartTime = std::chrono::steady_clock::now();
 
-        std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
-        std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime);
-        render_time = time_span.count();
+        shared_ptr<BVH> bvh;
+        if (data.bvh_cached)
+            bvh = make_shared<BVH>(*data.primitives, std::move(data.cached_nodes), std::move(data.cached_prim_indices));
+        else
+            bvh = make_shared<BVH>(*data.primitives, getBuildSettings());
+        data.blas = bvh;
+
+        std::chrono::duration<float, std::milli> build_span = std::chrono::steady_clock::now() - buildStartTime;
+
+        // the cache keeps the full precision nodes, compression is redone after every load
+        if (data.cache_valid && !data.bvh_cached)
+            BVHCache::save(data.cache_file, data.cache_key, data.packed, bvh->nodes, bvh->prim_indices);
+        vector<PackedTriangle>().swap(data.packed);
 
+        // leaf layout derived from the final tree, neither is part of the cache
+        std::chrono::steady_clock::time_point packStartTime = std::chrono::steady_clock::now();
+        if (init_info->CompressBVH)
+            bvh->compress();
+        bvh->packLeaves();
+        build_span += std::chrono::steady_clock::now() - packStartTime;
+
+        return build_span.count();
     }
 
-    void PathTracer::writeColor(unsigned char *pixels, ivec2 tex_size, ivec2 tex_coord, vec3 color, float gama)
+    void PathTracer::buildScene()
     {
-        auto r = color.r;
-        auto g = color.g;
-        auto b = color.b;
+        scene.clear();
+        tlas.reset();
+        placed.clear();
+
+        // a bottom level structure per unique model
+        build_time = 0.f;
+        bvh_cached = init_info->BVH;
+        if (init_info->BVH)
+            state = 1;
+        for (auto &data : model_data)
+        {
+            if (init_info->BVH)
+            {
+                build_time += buildModelBVH(data);
+                bvh_cached = bvh_cached && data.bvh_cached;
+            }
+            else
+            {
+                data.blas = data.primitives;
+            }
+        }
 
-        r = pow(r, 1 / gama);
-        g = pow(g, 1 / gama);
-        b = pow(b, 1 / gama);
+        // top level structure over the placements, unless the model is simply placed once as it is
+        if (instance_data.size() == 1 && instance_data[0].second == glm::mat4(1.f))
+        {
+            scene.add(model_data[instance_data[0].first].blas);
+        }
+        else
+        {
+            HittableList instance_list;
+            for (const auto &instance : instance_data)
+            {
+                placed.push_back(make_shared<Instance>(model_data[instance.first].blas, instance.second));
+                instance_list.add(placed.back());
+            }
 
-        pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 0] = static_cast<int>(256 * Math::clamp(r, 0.0, 0.999));
-        pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 1] = static_cast<int>(256 * Math::clamp(g, 0.0, 0.999));
-        pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 2] = static_cast<int>(256 * Math::clamp(b, 0.0, 0.999));
+            if (init_info->BVH)
+            {
+                std::chrono::steady_clock::time_point buildStartTime = std::chrono::steady_clock::now();
+                tlas = make_shared<BVH>(instance_list, getBuildSettings());
+                scene.add(tlas);
+                std::chrono::duration<float, std::milli> build_span = std::chrono::steady_clock::now() - buildStartTime;
+                build_time += build_span.count();
+            }
+            else
+            {
+                scene = instance_list;
+            }
+        }
+
+        scene_info = *init_info;
+        scene_valid = true;
     }
 
-    vec3 PathTracer::readColor(unsigned char *pixels, ivec2 tex_size, ivec2 tex_coord, float gama)
+    bool PathTracer::refitScene(const vector<ModelInstance> &instances)
     {
-        vec3 color;
+        // the same models in the same order, built with the same settings
+        if (!scene_valid || instances.size() != instance_data.size() ||
+            init_info->BVH != scene_info.BVH || init_info->BVHBuilder != scene_info.BVHBuilder ||
+            init_info->Restructure != scene_info.Restructure || init_info->SplitBudget != scene_info.SplitBudget ||
+            init_info->CompressBVH != scene_info.CompressBVH || init_info->PageTextures != scene_info.PageTextures)
+            return false;
+
+        vector<uint32_t> moved;
+        for (uint32_t i = 0; i < instances.size(); ++i)
+        {
+            if (instances[i].model != model_data[instance_data[i].first].model)
+                return false;
+            if (instances[i].transform != instance_data[i].second)
+                moved.push_back(i);
+        }
+
+        // a model placed once without a transform has no top level to move it with
+        if (!moved.empty() && placed.empty())
+            return false;
 
-        color.r = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 0] / 255.f, gama);
-        color.g = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 1] / 255.f, gama);
-        color.b = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 2] / 255.f, gama);
+        std::chrono::steady_clock::time_point refitStartTime = std::chrono::steady_clock::now();
+        for (uint32_t i : moved)
+        {
+            instance_data[i].second = instances[i].transform;
+            placed[i]->setTransform(instances[i].transform);
+        }
+
+        if (tlas && !moved.empty() && !tlas->refit(moved))
+        {
+            // the moves degraded the tree too far, rebuild the top level only
+            HittableList instance_list;
+            for (const auto &instance : placed)
+                instance_list.add(instance);
+            tlas = make_shared<BVH>(instance_list, getBuildSettings());
+            scene.clear();
+            scene.add(tlas);
+        }
+        std::chrono::duration<float, std::milli> refit_span = std::chrono::steady_clock::now() - refitStartTime;
+        build_time = refit_span.count();
 
-        return color;
+        collectLights();
+        return true;
     }
 
-    void PathTracer::transferModelData(shared_ptr<Model> m_model)
+    void PathTracer::transferModelData(const vector<ModelInstance> &instances)
     {
         // clean data buffer
-        mesh_data.clear();
-        light_data.clear();
-
-        // loop meshes
-        for (const auto &mesh : m_model->meshes)
+        scene_valid = false;
+        model_data.clear();
+        instance_data.clear();
+
+        // decode the textures of all models up front, in parallel and only if they are not cached yet
+        vector<std::string> texture_files;
+        for (const auto &instance : instances)
+            for (const auto &mesh : instance.model->meshes)
+                if (!mesh.material.map_Kd.empty())
+                    texture_files.push_back(instance.model->model_path + "/" + mesh.material.map_Kd);
+        textures.load(texture_files, init_info->PageTextures ? BVHCache::getCacheFolder() / "textures" : std::filesystem::path());
+
+        // every model is transferred once however often it is placed
+        std::map<shared_ptr<Model>, uint32_t> model_ids;
+        for (const auto &instance : instances)
         {
-            auto mat = make_shared<Phong>(mesh.material, m_model->model_path);
-
-            // loop triangles
-            for (int id = 0; id < mesh.indices.size(); id += 3)
+            auto it = model_ids.find(instance.model);
+            if (it == model_ids.end())
             {
-                vector<Vertex> vertices(3);
-                vertices[0] = mesh.vertices[mesh.indices[id]];
-                vertices[1] = mesh.vertices[mesh.indices[id + 1]];
-                vertices[2] = mesh.vertices[mesh.indices[id + 2]];
+                it = model_ids.emplace(instance.model, static_cast<uint32_t>(model_data.size())).first;
+                model_data.emplace_back();
+                model_data.back().model = instance.model;
+                transferModel(instance.model, model_data.back());
+            }
+            instance_data.emplace_back(it->second, instance.transform);
+        }
 
-                mesh_data.add(make_shared<Triangle>(vertices, mat));
+        collectLights();
+    }
 
-                if (mat->is_emitted(mat->mat))
-                {
-                    light_data.add(make_shared<Triangle>(vertices, shared_ptr<Material>()));
-                }
+    void PathTracer::collectLights()
+    {
+        light_data.clear();
+
+        // lights are sampled in world space, so every placement gets its own copy of the emitters
+        for (const auto &instance : instance_data)
+        {
+            for (const auto &emitter : model_data[instance.first].emitters)
+            {
+                auto vertices = emitter->vertices;
+                for (auto &vertex : vertices)
+                    vertex.Position = vec3(instance.second * vec4(vertex.Position, 1.f));
+                light_data.add(make_shared<Triangle>(vertices, nullptr));
             }
         }
 
@@ -369,8 +699,26 @@ namespace MiniEngine::PathTracing
         }
     }
 
+    void PathTracer::loadEnvironment()
+    {
+        // the map and its sampling distribution are kept until the file or the intensity changes
+        std::string file = init_info->EnvironmentMap;
+        if (file == environment_file && init_info->EnvironmentIntensity == environment_intensity)
+            return;
+
+        environment_file = file;
+        environment_intensity = init_info->EnvironmentIntensity;
+        environment.reset();
+        if (file.empty())
+            return;
+
+        auto map = make_shared<EnvironmentLight>();
+        if (map->load(file, environment_intensity))
+            environment = map;
+    }
+
     int PathTracer::getMainLightNumber()
     {
-        return light_data.objects.size();
+        return light_data.objects.size() + (environment ? 1 : 0);
     }
 }
\ No newline at end of file
@@ -4,12 +4,21 @@
 #include "runtime/function/render/pathtracing/common/ray.h"
 #include "runtime/function/render/pathtracing/common/hittable.h"
 #include "runtime/function/render/pathtracing/common/material.h"
+#include "runtime/function/render/pathtracing/common/texture_cache.h"
+#include "runtime/function/render/pathtracing/denoiser.h"
+#include "runtime/function/render/pathtracing/atrous_filter.h"
+#include "runtime/function/render/pathtracing/post_process.h"
+#include "runtime/function/render/pathtracing/image_writer.h"
+#include "runtime/function/render/pathtracing/camera_path.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
 #include "runtime/function/render/render_model.h"
 #include "runtime/function/render/render_camera.h"
 
 #include <glm/glm.hpp>
-#include <stb_image_write.h>
 
+#include <chrono>
+#include <limits>
 #include <map>
 
 namespace MiniEngine::PathTracing
@@ -21,10 +30,49 @@ namespace MiniEngine::PathTracing
         int BounceLimit;
         bool ImportSample;
         bool BVH;
+        int BVHBuilder;
+        bool Restructure;
+        float SplitBudget;
+        bool CacheBVH;
+        bool CompressBVH;
+        bool PageTextures; // map textures from tiled files in the cache folder instead of holding them in memory
         bool MultiThread;
         bool Denoise;
+        int DenoiseFilter;   // DenoiseFilterType
+        bool DenoisePreview; // denoise the finished rows while tracing, in the background for Open Image Denoise
+        float Exposure;  // in stops
+        int ToneMapper;  // ToneMapperType
+        bool Dither;
         bool Output;
+        int OutputFormat; // ImageFormatType, the extension of SavePath follows it
         char SavePath[128];
+        bool Sequence;   // render the camera path frame by frame instead of a single image
+        float FrameRate; // frames per second of the camera path
+        char EnvironmentMap[128]; // equirectangular HDR lighting the scene, none if empty
+        float EnvironmentIntensity;
+    };
+
+    // What the denoiser is guided by, taken where a path first meets a surface that is not a perfect mirror or glass
+    struct SampleFeatures
+    {
+        vec3 albedo{0, 0, 0};
+        vec3 normal{0, 0, 0};
+        float depth{0}; // distance along the path to that surface, 0 if there is none
+    };
+
+    class Triangle;
+    class Instance;
+    class EnvironmentLight;
+    class PrimitiveSet;
+
+    const size_t INVALID_OBJECT_ID = std::numeric_limits<size_t>::max();
+
+    // One placement of a model in the scene, instances of the same model share its triangles and BVH
+    struct ModelInstance
+    {
+        shared_ptr<Model> model;
+        glm::mat4 transform{1.f};
+        size_t object_id{INVALID_OBJECT_ID}; // owner of the placement, reported back by scene queries
     };
 
     class PathTracer
@@ -34,27 +82,92 @@ namespace MiniEngine::PathTracing
         int height;
         unsigned int result;
         bool should_stop_tracing{false};
-        unsigned char *pixels = nullptr;
+        unsigned char *pixels = nullptr; // post processed radiance, what the canvas shows
+        vector<vec3> radiance;            // linear HDR estimate of every pixel, bottom row first
+        vector<vec3> albedo;              // per pixel averages of the sample features, same layout
+        vector<vec3> normal;
+        vector<float> depth;
         shared_ptr<RenderingInitInfo> init_info;
         int state;
         float progress;
         float render_time;
+        float build_time;
+        bool bvh_cached{false};
+        bool bvh_refitted{false};
+        CameraPath camera_path; // edited in the editor, a sequence renders a copy of it
+        bool in_sequence{false};
+        int frame{0};       // frame of the sequence being rendered
+        int frame_count{0}; // frames in the sequence
 
         PathTracer();
 
         void initializeRenderer();
-        void startTracing(shared_ptr<Model> m_model, shared_ptr<MiniEngine::Camera> m_camera);
-        void transferModelData(shared_ptr<Model> m_model);
+        void startTracing(vector<ModelInstance> instances, shared_ptr<MiniEngine::Camera> m_camera);
+        // renders the camera path at the frame rate, frames are written to disk numbered after the save path
+        void startSequence(vector<ModelInstance> instances, shared_ptr<MiniEngine::Camera> m_camera, CameraPath path);
+        void transferModelData(const vector<ModelInstance> &instances);
 
         int getMainLightNumber();
 
     private:
-        HittableList mesh_data;
+        // object space triangles of one unique model and its bottom level BVH
+        struct ModelData
+        {
+            shared_ptr<Model> model;
+            shared_ptr<PrimitiveSet> primitives;
+            shared_ptr<MaterialTable> materials;
+            vector<shared_ptr<Triangle>> emitters;
+            shared_ptr<Hittable> blas;
+
+            // packed triangles and, on a cache hit, the BVH loaded with them
+            vector<PackedTriangle> packed;
+            vector<BVHNode> cached_nodes;
+            vector<uint32_t> cached_prim_indices;
+            uint64_t cache_key;
+            bool cache_valid{false};
+            bool bvh_cached{false};
+            std::filesystem::path cache_file;
+        };
+
+        vector<ModelData> model_data;
+        vector<pair<uint32_t, glm::mat4>> instance_data;
         HittableList light_data;
+        shared_ptr<EnvironmentLight> environment;
+        std::string environment_file;
+        float environment_intensity{0.f};
+        // decoded model textures, kept across renders and shared by all models
+        TextureCache textures;
+        // created with the first denoised render and kept for the next ones
+        static const int PREVIEW_INTERVAL = 2000;       // milliseconds between background previews
+        static const int FILTER_PREVIEW_INTERVAL = 250; // milliseconds between edge-aware previews
+        shared_ptr<Denoiser> denoiser;
+        ATrousFilter atrous;
+        PostProcess post_process;
+        // created with the first image written to disk, finishes writing it while the next render runs
+        shared_ptr<ImageWriter> writer;
+        vector<vec3> preview;
+        std::chrono::steady_clock::time_point last_preview;
+        std::chrono::steady_clock::duration preview_cost; // how long the last edge-aware preview took
+
+        // the built scene is kept between renders, so moving instances only refits the top level
+        HittableList scene;
+        shared_ptr<BVH> tlas;
+        vector<shared_ptr<Instance>> placed;
+        RenderingInitInfo scene_info;
+        bool scene_valid{false};
+
+        BVHBuildSettings getBuildSettings() const;
+        void packTriangles(shared_ptr<Model> m_model, ModelData &data);
+        void transferModel(shared_ptr<Model> m_model, ModelData &data);
+        float buildModelBVH(ModelData &data);
+        void buildScene();
+        bool refitScene(const vector<ModelInstance> &instances);
+        void collectLights();
+        void loadEnvironment();
 
-        glm::vec3 getColor(const Ray &r, const Hittable &model, shared_ptr<HittableList> &lights, int depth, bool importance_sampling);
-        void writeColor(unsigned char *pixels, glm::ivec2 tex_size, glm::ivec2 tex_coord, glm::vec3 color, float gama);
-        glm::vec3 readColor(unsigned char *pixels, glm::ivec2 tex_size, glm::ivec2 tex_coord, float gama);
+        glm::vec3 getColor(const Ray &r, const Hittable &model, shared_ptr<HittableList> &lights, int depth, bool importance_sampling, SampleFeatures *features = nullptr);
+        void updatePreview(int first_row, bool edge_aware);
+        void tonemap(const vector<vec3> &source, int first_row, int end_row);
 
         static bool hittableCompare(pair<shared_ptr<Hittable>, float> a, pair<shared_ptr<Hittable>, float> b) {return a.second > b.second;}
     };
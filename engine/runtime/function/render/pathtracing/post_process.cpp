@@ -0,0 +1,97 @@
+#include "runtime/function/render/pathtracing/post_process.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    static_assert(sizeof(vec3) == 3 * sizeof(float), "rows are processed as packed channels");
+
+    // 8 x 8 Bayer matrix, thresholds spread evenly over one output step
+    static const unsigned char BAYER[8][8] = {
+        {0, 32, 8, 40, 2, 34, 10, 42},
+        {48, 16, 56, 24, 50, 18, 58, 26},
+        {12, 44, 4, 36, 14, 46, 6, 38},
+        {60, 28, 52, 20, 62, 30, 54, 22},
+        {3, 35, 11, 43, 1, 33, 9, 41},
+        {51, 19, 59, 27, 49, 17, 57, 25},
+        {15, 47, 7, 39, 13, 45, 5, 37},
+        {63, 31, 55, 23, 61, 29, 53, 21}};
+
+    PostProcess::PostProcess()
+    {
+        for (int i = 0; i <= ENCODE_STEPS; ++i)
+        {
+            float linear = static_cast<float>(i) / ENCODE_STEPS;
+            float srgb = linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f;
+            encode[i] = 255.f * srgb + 0.5f;
+        }
+    }
+
+    void PostProcess::apply(const vec3 *source, unsigned char *pixels, int width, int first_row, int end_row) const
+    {
+        if (end_row - first_row == 1)
+        {
+            applyRow(source, pixels, width, first_row);
+            return;
+        }
+
+        tbb::parallel_for(first_row, end_row, [this, source, pixels, width](int y)
+                          { applyRow(source, pixels, width, y); });
+    }
+
+    void PostProcess::applyRow(const vec3 *source, unsigned char *pixels, int width, int y) const
+    {
+        const float *row_in = reinterpret_cast<const float *>(source + static_cast<size_t>(y) * width);
+        unsigned char *row_out = pixels + static_cast<size_t>(y) * 3 * width;
+        const float scale = std::exp2(exposure);
+        const unsigned char *bayer = BAYER[y & 7];
+
+        // the row goes through in spans that fit a buffer on the stack, so no row allocates
+        float d[3 * SPAN];
+        for (int first = 0; first < width; first += SPAN)
+        {
+            const int count = std::min(SPAN, width - first);
+            const int channels = 3 * count;
+            const float *in = row_in + 3 * first;
+            unsigned char *out = row_out + 3 * first;
+
+            // exposure and tone curve, straight into encode table positions
+            switch (tone_mapper)
+            {
+            case ToneMapperType::REINHARD:
+                for (int k = 0; k < channels; ++k)
+                {
+                    float v = in[k] * scale;
+                    d[k] = v / (1.f + v) * ENCODE_STEPS;
+                }
+                break;
+            case ToneMapperType::ACES:
+                // Narkowicz's fit, with the 0.6 exposure of the reference folded in
+                for (int k = 0; k < channels; ++k)
+                {
+                    float v = in[k] * (0.6f * scale);
+                    d[k] = v * (2.51f * v + 0.03f) / (v * (2.43f * v + 0.59f) + 0.14f) * ENCODE_STEPS;
+                }
+                break;
+            default:
+                for (int k = 0; k < channels; ++k)
+                    d[k] = in[k] * (scale * ENCODE_STEPS);
+                break;
+            }
+
+            // NaN fails the first test and comes out black
+            for (int x = 0; x < count; ++x)
+            {
+                float threshold = dither ? bayer[(first + x) & 7] / 64.f - 0.5f : 0.f;
+                for (int c = 0; c < 3; ++c)
+                {
+                    int k = 3 * x + c;
+                    float position = d[k] > 0.f ? std::min(d[k], static_cast<float>(ENCODE_STEPS)) : 0.f;
+                    int value = static_cast<int>(encode[static_cast<int>(position)] + threshold);
+                    out[k] = static_cast<unsigned char>(std::min(std::max(value, 0), 255));
+                }
+            }
+        }
+    }
+}
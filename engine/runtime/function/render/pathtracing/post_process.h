@@ -0,0 +1,38 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+namespace MiniEngine::PathTracing
+{
+    enum class ToneMapperType : int
+    {
+        NONE = 0,     // clip at white
+        REINHARD = 1, // x / (1 + x), keeps every highlight at the cost of contrast
+        ACES = 2,     // filmic curve fitted to the ACES reference rendering transform
+    };
+
+    // The one conversion from the linear HDR estimate to the 8 bit sRGB of the canvas and the PNG output: exposure,
+    // tone mapping, sRGB encoding and optional ordered dithering. The curves run over whole rows of channels without
+    // branches, so they vectorize, and the encoding is a table lookup instead of pow.
+    class PostProcess
+    {
+    public:
+        float exposure{0.f}; // in stops
+        ToneMapperType tone_mapper{ToneMapperType::NONE};
+        bool dither{false};
+
+        PostProcess();
+
+        // converts rows [first_row, end_row) of a width wide image to packed RGB bytes in the same layout
+        void apply(const vec3 *source, unsigned char *pixels, int width, int first_row, int end_row) const;
+
+    private:
+        static const int ENCODE_STEPS = 4096;
+        // pixels converted at a time, their display values take 3 KB of stack
+        static const int SPAN = 256;
+        // sRGB encoding of display values i / ENCODE_STEPS in units of output steps, rounding offset included
+        float encode[ENCODE_STEPS + 1];
+
+        void applyRow(const vec3 *source, unsigned char *pixels, int width, int y) const;
+    };
+}
@@ -11,33 +11,63 @@ namespace MiniEngine::PathTracing
     public:
         vec3 box_min;
         vec3 box_max;
-        HittableList sides;
+        // the two sides facing each axis, stored by type so they are tested without virtual calls
+        RectangleXY sides_xy[2];
+        RectangleXZ sides_xz[2];
+        RectangleYZ sides_yz[2];
 
     
         Box() {}
-        Box(const vec3 &p0, const vec3 &p1, shared_ptr<Material> ptr);
+        Box(const vec3 &p0, const vec3 &p1, const Material *ptr);
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override { rec.prim->fillHit(r, rec); }
     };
 
-    Box::Box(const vec3 &p0, const vec3 &p1, shared_ptr<Material> ptr)
+    inline Box::Box(const vec3 &p0, const vec3 &p1, const Material *ptr)
     {
         box_min = p0;
         box_max = p1;
 
-        sides.add(make_shared<RectangleXY>(p0.x, p1.x, p0.y, p1.y, p1.z, ptr));
-        sides.add(make_shared<RectangleXY>(p0.x, p1.x, p0.y, p1.y, p0.z, ptr));
+        sides_xy[0] = RectangleXY(p0.x, p1.x, p0.y, p1.y, p1.z, ptr);
+        sides_xy[1] = RectangleXY(p0.x, p1.x, p0.y, p1.y, p0.z, ptr);
 
-        sides.add(make_shared<RectangleXZ>(p0.x, p1.x, p0.z, p1.z, p1.y, ptr));
-        sides.add(make_shared<RectangleXZ>(p0.x, p1.x, p0.z, p1.z, p0.y, ptr));
+        sides_xz[0] = RectangleXZ(p0.x, p1.x, p0.z, p1.z, p1.y, ptr);
+        sides_xz[1] = RectangleXZ(p0.x, p1.x, p0.z, p1.z, p0.y, ptr);
 
-        sides.add(make_shared<RectangleYZ>(p0.y, p1.y, p0.z, p1.z, p1.x, ptr));
-        sides.add(make_shared<RectangleYZ>(p0.y, p1.y, p0.z, p1.z, p0.x, ptr));
+        sides_yz[0] = RectangleYZ(p0.y, p1.y, p0.z, p1.z, p1.x, ptr);
+        sides_yz[1] = RectangleYZ(p0.y, p1.y, p0.z, p1.z, p0.x, ptr);
     }
 
-    bool Box::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool Box::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
-        return sides.hit(r, t_min, t_max, rec);
+        bool hit_anything = false;
+        for (int k = 0; k < 2; ++k)
+        {
+            if (sides_xy[k].hit(r, t_min, t_max, rec))
+            {
+                hit_anything = true;
+                t_max = rec.t;
+            }
+            if (sides_xz[k].hit(r, t_min, t_max, rec))
+            {
+                hit_anything = true;
+                t_max = rec.t;
+            }
+            if (sides_yz[k].hit(r, t_min, t_max, rec))
+            {
+                hit_anything = true;
+                t_max = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    inline bool Box::aabb(AABB &bounding_box) const
+    {
+        bounding_box = AABB(box_min, box_max);
+        return true;
     }
 
     class Translate : public Hittable
@@ -49,20 +79,38 @@ namespace MiniEngine::PathTracing
         Translate(shared_ptr<Hittable> p, const vec3 &displacement) : ptr(p), offset(displacement) {}
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
     };
 
-    bool Translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool Translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         Ray moved_r(r.origin - offset, r.direction);
         if (!ptr->hit(moved_r, t_min, t_max, rec))
             return false;
 
-        rec.hit_point.Position += offset;
-        rec.setFaceNormal(moved_r, rec.hit_point.Normal);
+        rec.object = this;
+        return true;
+    }
 
+    inline bool Translate::aabb(AABB &bounding_box) const
+    {
+        if (!ptr->aabb(bounding_box))
+            return false;
+
+        bounding_box = AABB(bounding_box.min + offset, bounding_box.max + offset);
         return true;
     }
 
+    inline void Translate::fillHit(const Ray &r, HitRecord &rec) const
+    {
+        Ray moved_r(r.origin - offset, r.direction);
+        ptr->fillHit(moved_r, rec);
+
+        rec.hit_point.Position += offset;
+        rec.setFaceNormal(moved_r, rec.hit_point.Normal);
+    }
+
     class RotateY : public Hittable
     {
     public:
@@ -73,16 +121,21 @@ namespace MiniEngine::PathTracing
         RotateY(shared_ptr<Hittable> p, float angle);
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+
+    private:
+        Ray rotate(const Ray &r) const;
     };
 
-    RotateY::RotateY(shared_ptr<Hittable> p, float angle) : ptr(p)
+    inline RotateY::RotateY(shared_ptr<Hittable> p, float angle) : ptr(p)
     {
         auto radians = glm::radians(angle);
         sin_theta = sin(radians);
         cos_theta = cos(radians);
     }
 
-    bool RotateY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline Ray RotateY::rotate(const Ray &r) const
     {
         auto origin = r.origin;
         auto direction = r.direction;
@@ -93,11 +146,39 @@ namespace MiniEngine::PathTracing
         direction[0] = cos_theta * r.direction[0] - sin_theta * r.direction[2];
         direction[2] = sin_theta * r.direction[0] + cos_theta * r.direction[2];
 
-        Ray rotated_r(origin, direction);
+        return Ray(origin, direction);
+    }
 
-        if (!ptr->hit(rotated_r, t_min, t_max, rec))
+    inline bool RotateY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (!ptr->hit(rotate(r), t_min, t_max, rec))
             return false;
 
+        rec.object = this;
+        return true;
+    }
+
+    inline bool RotateY::aabb(AABB &bounding_box) const
+    {
+        AABB box;
+        if (!ptr->aabb(box))
+            return false;
+
+        // bound the corners rotated back into the outer space
+        bounding_box = AABB::empty();
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            vec3 p(box.bound(corner & 1).x, box.bound((corner >> 1) & 1).y, box.bound(corner >> 2).z);
+            bounding_box.expand(vec3(cos_theta * p.x + sin_theta * p.z, p.y, -sin_theta * p.x + cos_theta * p.z));
+        }
+        return true;
+    }
+
+    inline void RotateY::fillHit(const Ray &r, HitRecord &rec) const
+    {
+        Ray rotated_r = rotate(r);
+        ptr->fillHit(rotated_r, rec);
+
         auto p = rec.hit_point.Position;
         auto normal = rec.hit_point.Normal;
 
@@ -109,7 +190,5 @@ namespace MiniEngine::PathTracing
 
         rec.hit_point.Position = p;
         rec.setFaceNormal(rotated_r, normal);
-
-        return true;
     }
 }
\ No newline at end of file
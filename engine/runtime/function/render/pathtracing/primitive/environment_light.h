@@ -0,0 +1,133 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/common/distribution.h"
+
+#include <stb_image.h>
+
+#include <string>
+
+namespace MiniEngine::PathTracing
+{
+    // Light from infinitely far away, given as an equirectangular HDR image with +y up. It sits in the light list
+    // next to the emitters, so it is picked by light selection and mixed with the BSDF pdf like any other light,
+    // and rays that leave the scene return its radiance. Directions are drawn in proportion to the luminance of
+    // the texels, which finds a small bright sun that uniform sampling would almost never hit.
+    class EnvironmentLight : public Hittable
+    {
+    public:
+        EnvironmentLight() {}
+
+        bool load(const std::string &file, float intensity);
+        bool isValid() const { return !pixels.empty(); }
+
+        vec3 getRadiance(const vec3 &direction) const;
+
+        // never part of the scene geometry, only sampled
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override { return false; }
+        virtual bool aabb(AABB &bounding_box) const override { return false; }
+
+        virtual float getPDF(const vec3 &origin, const vec3 &v) const override;
+        virtual vec3 random(const vec3 &origin) const override;
+
+    private:
+        vector<vec3> pixels;
+        int width{0};
+        int height{0};
+        float scale{1.f};
+        Distribution2D distribution;
+
+        static vec2 toImage(const vec3 &direction);
+        static vec3 fromImage(const vec2 &uv);
+    };
+
+    inline bool EnvironmentLight::load(const std::string &file, float intensity)
+    {
+        pixels.clear();
+
+        // row 0 is the top of the sky, every other loader wants the flip so it is switched back on after
+        stbi_set_flip_vertically_on_load_thread(false);
+        int channels;
+        float *data = stbi_loadf(file.c_str(), &width, &height, &channels, 3);
+        stbi_set_flip_vertically_on_load_thread(true);
+        if (!data)
+        {
+            std::cerr << "ERROR: Could not load environment map '" << file << "'.\n";
+            width = height = 0;
+            return false;
+        }
+
+        pixels.resize(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = vec3(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+        stbi_image_free(data);
+        scale = intensity;
+
+        // rows near the poles cover less solid angle, weight them by sin(theta)
+        vector<float> weights(pixels.size());
+        for (int y = 0; y < height; ++y)
+        {
+            float sin_theta = sin(PI * (y + 0.5f) / height);
+            for (int x = 0; x < width; ++x)
+            {
+                const vec3 &c = pixels[static_cast<size_t>(y) * width + x];
+                weights[static_cast<size_t>(y) * width + x] = (0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b) * sin_theta;
+            }
+        }
+        distribution = Distribution2D(weights.data(), width, height);
+
+        return true;
+    }
+
+    inline vec2 EnvironmentLight::toImage(const vec3 &direction)
+    {
+        vec3 d = normalize(direction);
+        float phi = atan2(d.z, d.x);
+        if (phi < 0)
+            phi += 2 * PI;
+        float theta = acos(glm::clamp(d.y, -1.f, 1.f));
+        return vec2(phi / (2 * PI), theta / PI);
+    }
+
+    inline vec3 EnvironmentLight::fromImage(const vec2 &uv)
+    {
+        float phi = uv.x * 2 * PI;
+        float theta = uv.y * PI;
+        float sin_theta = sin(theta);
+        return vec3(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+    }
+
+    inline vec3 EnvironmentLight::getRadiance(const vec3 &direction) const
+    {
+        if (pixels.empty())
+            return vec3(0, 0, 0);
+
+        vec2 uv = toImage(direction);
+        int x = glm::clamp(static_cast<int>(uv.x * width), 0, width - 1);
+        int y = glm::clamp(static_cast<int>(uv.y * height), 0, height - 1);
+        return scale * pixels[static_cast<size_t>(y) * width + x];
+    }
+
+    inline float EnvironmentLight::getPDF(const vec3 &origin, const vec3 &v) const
+    {
+        if (pixels.empty())
+            return 0;
+
+        // from the density over the image to solid angle, dw = 2 pi^2 sin(theta) du dv
+        vec2 uv = toImage(v);
+        float sin_theta = sin(uv.y * PI);
+        if (sin_theta <= 0)
+            return 0;
+        return distribution.getPDF(uv) / (2 * PI * PI * sin_theta);
+    }
+
+    inline vec3 EnvironmentLight::random(const vec3 &origin) const
+    {
+        if (pixels.empty())
+            return vec3(0, 1, 0);
+
+        float pdf;
+        vec2 uv = distribution.sample(vec2(linearRand(0.f, 1.f), linearRand(0.f, 1.f)), pdf);
+        return fromImage(uv);
+    }
+}
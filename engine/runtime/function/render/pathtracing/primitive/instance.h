@@ -0,0 +1,103 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/hittable.h"
+
+namespace MiniEngine::PathTracing
+{
+    // One placement of shared geometry. Rays are moved into object space at the instance boundary instead of
+    // copying the geometry, so a model placed many times is stored and built only once.
+    class Instance : public Hittable
+    {
+    public:
+        shared_ptr<Hittable> ptr;
+        mat4 object_to_world;
+        mat4 world_to_object;
+        mat3 normal_to_world;
+        AABB world_box;
+        bool has_box;
+
+        Instance(shared_ptr<Hittable> p, const mat4 &transform);
+
+        void setTransform(const mat4 &transform);
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+    };
+
+    inline Instance::Instance(shared_ptr<Hittable> p, const mat4 &transform) : ptr(p)
+    {
+        setTransform(transform);
+    }
+
+    inline void Instance::setTransform(const mat4 &transform)
+    {
+        object_to_world = transform;
+        world_to_object = inverse(transform);
+        normal_to_world = transpose(mat3(world_to_object));
+
+        AABB box;
+        has_box = ptr->aabb(box);
+        if (has_box)
+        {
+            world_box = AABB::empty();
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                vec3 p(box.bound(corner & 1).x, box.bound((corner >> 1) & 1).y, box.bound(corner >> 2).z);
+                world_box.expand(vec3(transform * vec4(p, 1.f)));
+            }
+        }
+    }
+
+    inline bool Instance::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        vec3 origin = vec3(world_to_object * vec4(r.origin, 1.f));
+        vec3 direction = mat3(world_to_object) * r.direction;
+
+        // the object space ray is normalized again, so distances along it scale by the transformed length
+        float scale = length(direction);
+        Ray object_r(origin, direction);
+        if (!ptr->hit(object_r, t_min * scale, t_max * scale, rec))
+            return false;
+
+        rec.t /= scale;
+        rec.object = this;
+
+        return true;
+    }
+
+    inline void Instance::fillHit(const Ray &r, HitRecord &rec) const
+    {
+        vec3 origin = vec3(world_to_object * vec4(r.origin, 1.f));
+        vec3 direction = mat3(world_to_object) * r.direction;
+
+        float scale = length(direction);
+        Ray object_r(origin, direction);
+        rec.t *= scale;
+        ptr->fillHit(object_r, rec);
+
+        rec.t /= scale;
+        rec.hit_point.Position = r.cast(rec.t);
+        // the normal already faces the ray, and the inverse transpose keeps it that way
+        rec.hit_point.Normal = normalize(normal_to_world * rec.hit_point.Normal);
+        rec.dpdu = mat3(object_to_world) * rec.dpdu;
+        rec.dpdv = mat3(object_to_world) * rec.dpdv;
+    }
+
+    inline bool Instance::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        vec3 origin = vec3(world_to_object * vec4(r.origin, 1.f));
+        vec3 direction = mat3(world_to_object) * r.direction;
+
+        float scale = length(direction);
+        return ptr->occluded(Ray(origin, direction), t_min * scale, t_max * scale);
+    }
+
+    inline bool Instance::aabb(AABB &bounding_box) const
+    {
+        bounding_box = world_box;
+        return has_box;
+    }
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/primitive/triangle.h"
+#include "runtime/function/render/pathtracing/primitive/sphere.h"
+#include "runtime/function/render/pathtracing/primitive/rectangle.h"
+#include "runtime/function/render/pathtracing/primitive/box.h"
+
+#include <cstdint>
+
+namespace MiniEngine::PathTracing
+{
+    // A primitive id carries its type in the top bits and the index into the array of that type in the rest.
+    // Triangles are type 0, so in a triangle only set an id is just the triangle index.
+    enum class PrimitiveType : uint32_t
+    {
+        Triangle = 0,
+        Sphere = 1,
+        RectangleXY = 2,
+        RectangleXZ = 3,
+        RectangleYZ = 4,
+        Count = 5,
+    };
+
+    const int PRIMITIVE_TYPE_SHIFT = 28;
+    const uint32_t PRIMITIVE_INDEX_MASK = (1u << PRIMITIVE_TYPE_SHIFT) - 1;
+
+    inline uint32_t makePrimitiveId(PrimitiveType type, uint32_t index)
+    {
+        return static_cast<uint32_t>(type) << PRIMITIVE_TYPE_SHIFT | index;
+    }
+
+    inline PrimitiveType getPrimitiveType(uint32_t id)
+    {
+        return static_cast<PrimitiveType>(id >> PRIMITIVE_TYPE_SHIFT);
+    }
+
+    inline uint32_t getPrimitiveIndex(uint32_t id)
+    {
+        return id & PRIMITIVE_INDEX_MASK;
+    }
+
+    // Scene geometry as one contiguous array per primitive type. The shapes are final, so the calls made through
+    // the switch on the id type are resolved at compile time, and nothing is reference counted. Slots number all
+    // primitives consecutively, array after array in type order, for code that wants a dense index.
+    class PrimitiveSet : public Hittable
+    {
+    public:
+        vector<Triangle> triangles;
+        vector<Sphere> spheres;
+        vector<RectangleXY> rectangles_xy;
+        vector<RectangleXZ> rectangles_xz;
+        vector<RectangleYZ> rectangles_yz;
+
+        uint32_t add(const Triangle &triangle) { return push(triangles, triangle, PrimitiveType::Triangle); }
+        uint32_t add(const Sphere &sphere) { return push(spheres, sphere, PrimitiveType::Sphere); }
+        uint32_t add(const RectangleXY &rectangle) { return push(rectangles_xy, rectangle, PrimitiveType::RectangleXY); }
+        uint32_t add(const RectangleXZ &rectangle) { return push(rectangles_xz, rectangle, PrimitiveType::RectangleXZ); }
+        uint32_t add(const RectangleYZ &rectangle) { return push(rectangles_yz, rectangle, PrimitiveType::RectangleYZ); }
+        // a box goes in as its six sides
+        void add(const Box &box);
+
+        void clear();
+        uint32_t size() const;
+        uint32_t getId(uint32_t slot) const;
+        uint32_t getSlot(uint32_t id) const;
+        const Hittable *get(uint32_t id) const;
+
+        bool hitPrimitive(uint32_t id, const Ray &r, float t_min, float t_max, HitRecord &rec) const;
+        bool aabbPrimitive(uint32_t id, AABB &bounding_box) const;
+        void splitPrimitive(uint32_t id, int axis, float position, const AABB &box, AABB &left, AABB &right) const;
+        bool getTrianglePrimitive(uint32_t id, vec3 &v0, vec3 &v1, vec3 &v2) const;
+
+        // the whole set without an acceleration structure
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override { rec.prim->fillHit(r, rec); }
+
+    private:
+        template <typename T>
+        uint32_t push(vector<T> &array, const T &primitive, PrimitiveType type)
+        {
+            array.push_back(primitive);
+            return makePrimitiveId(type, static_cast<uint32_t>(array.size() - 1));
+        }
+
+        uint32_t getCount(PrimitiveType type) const;
+
+        // a whole array at a time, so the calls resolve statically without decoding ids
+        template <typename T>
+        static bool hitArray(const vector<T> &array, const Ray &r, float t_min, float &t_max, HitRecord &rec)
+        {
+            bool hit_anything = false;
+            for (const T &primitive : array)
+            {
+                if (primitive.hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+            return hit_anything;
+        }
+
+        template <typename T>
+        static bool expandArray(const vector<T> &array, AABB &bounding_box)
+        {
+            for (const T &primitive : array)
+            {
+                AABB box;
+                if (!primitive.aabb(box))
+                    return false;
+                bounding_box.expand(box);
+            }
+            return true;
+        }
+    };
+
+    inline void PrimitiveSet::add(const Box &box)
+    {
+        for (int k = 0; k < 2; ++k)
+            add(box.sides_xy[k]);
+        for (int k = 0; k < 2; ++k)
+            add(box.sides_xz[k]);
+        for (int k = 0; k < 2; ++k)
+            add(box.sides_yz[k]);
+    }
+
+    inline void PrimitiveSet::clear()
+    {
+        triangles.clear();
+        spheres.clear();
+        rectangles_xy.clear();
+        rectangles_xz.clear();
+        rectangles_yz.clear();
+    }
+
+    inline uint32_t PrimitiveSet::getCount(PrimitiveType type) const
+    {
+        switch (type)
+        {
+        case PrimitiveType::Triangle:
+            return static_cast<uint32_t>(triangles.size());
+        case PrimitiveType::Sphere:
+            return static_cast<uint32_t>(spheres.size());
+        case PrimitiveType::RectangleXY:
+            return static_cast<uint32_t>(rectangles_xy.size());
+        case PrimitiveType::RectangleXZ:
+            return static_cast<uint32_t>(rectangles_xz.size());
+        case PrimitiveType::RectangleYZ:
+            return static_cast<uint32_t>(rectangles_yz.size());
+        default:
+            return 0;
+        }
+    }
+
+    inline uint32_t PrimitiveSet::size() const
+    {
+        uint32_t count = 0;
+        for (uint32_t type = 0; type < static_cast<uint32_t>(PrimitiveType::Count); ++type)
+            count += getCount(static_cast<PrimitiveType>(type));
+        return count;
+    }
+
+    inline uint32_t PrimitiveSet::getId(uint32_t slot) const
+    {
+        uint32_t type = 0;
+        for (; type + 1 < static_cast<uint32_t>(PrimitiveType::Count); ++type)
+        {
+            uint32_t count = getCount(static_cast<PrimitiveType>(type));
+            if (slot < count)
+                break;
+            slot -= count;
+        }
+        return makePrimitiveId(static_cast<PrimitiveType>(type), slot);
+    }
+
+    inline uint32_t PrimitiveSet::getSlot(uint32_t id) const
+    {
+        uint32_t slot = getPrimitiveIndex(id);
+        for (uint32_t type = 0; type < static_cast<uint32_t>(getPrimitiveType(id)); ++type)
+            slot += getCount(static_cast<PrimitiveType>(type));
+        return slot;
+    }
+
+    inline const Hittable *PrimitiveSet::get(uint32_t id) const
+    {
+        uint32_t index = getPrimitiveIndex(id);
+        switch (getPrimitiveType(id))
+        {
+        case PrimitiveType::Triangle:
+            return &triangles[index];
+        case PrimitiveType::Sphere:
+            return &spheres[index];
+        case PrimitiveType::RectangleXY:
+            return &rectangles_xy[index];
+        case PrimitiveType::RectangleXZ:
+            return &rectangles_xz[index];
+        case PrimitiveType::RectangleYZ:
+            return &rectangles_yz[index];
+        default:
+            return nullptr;
+        }
+    }
+
+    inline bool PrimitiveSet::hitPrimitive(uint32_t id, const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        uint32_t index = getPrimitiveIndex(id);
+        switch (getPrimitiveType(id))
+        {
+        case PrimitiveType::Triangle:
+            return triangles[index].hit(r, t_min, t_max, rec);
+        case PrimitiveType::Sphere:
+            return spheres[index].hit(r, t_min, t_max, rec);
+        case PrimitiveType::RectangleXY:
+            return rectangles_xy[index].hit(r, t_min, t_max, rec);
+        case PrimitiveType::RectangleXZ:
+            return rectangles_xz[index].hit(r, t_min, t_max, rec);
+        case PrimitiveType::RectangleYZ:
+            return rectangles_yz[index].hit(r, t_min, t_max, rec);
+        default:
+            return false;
+        }
+    }
+
+    inline bool PrimitiveSet::aabbPrimitive(uint32_t id, AABB &bounding_box) const
+    {
+        uint32_t index = getPrimitiveIndex(id);
+        switch (getPrimitiveType(id))
+        {
+        case PrimitiveType::Triangle:
+            return triangles[index].aabb(bounding_box);
+        case PrimitiveType::Sphere:
+            return spheres[index].aabb(bounding_box);
+        case PrimitiveType::RectangleXY:
+            return rectangles_xy[index].aabb(bounding_box);
+        case PrimitiveType::RectangleXZ:
+            return rectangles_xz[index].aabb(bounding_box);
+        case PrimitiveType::RectangleYZ:
+            return rectangles_yz[index].aabb(bounding_box);
+        default:
+            return false;
+        }
+    }
+
+    inline void PrimitiveSet::splitPrimitive(uint32_t id, int axis, float position, const AABB &box, AABB &left, AABB &right) const
+    {
+        // only triangles clip exactly, the other shapes take the plain cut of their box
+        if (getPrimitiveType(id) == PrimitiveType::Triangle)
+            triangles[getPrimitiveIndex(id)].splitAABB(axis, position, box, left, right);
+        else
+            Hittable::splitAABB(axis, position, box, left, right);
+    }
+
+    inline bool PrimitiveSet::getTrianglePrimitive(uint32_t id, vec3 &v0, vec3 &v1, vec3 &v2) const
+    {
+        if (getPrimitiveType(id) != PrimitiveType::Triangle)
+            return false;
+        return triangles[getPrimitiveIndex(id)].getTriangle(v0, v1, v2);
+    }
+
+    inline bool PrimitiveSet::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        bool hit_anything = hitArray(triangles, r, t_min, t_max, rec);
+        hit_anything |= hitArray(spheres, r, t_min, t_max, rec);
+        hit_anything |= hitArray(rectangles_xy, r, t_min, t_max, rec);
+        hit_anything |= hitArray(rectangles_xz, r, t_min, t_max, rec);
+        hit_anything |= hitArray(rectangles_yz, r, t_min, t_max, rec);
+        return hit_anything;
+    }
+
+    inline bool PrimitiveSet::aabb(AABB &bounding_box) const
+    {
+        if (size() == 0)
+            return false;
+
+        bounding_box = AABB::empty();
+        return expandArray(triangles, bounding_box) && expandArray(spheres, bounding_box) &&
+               expandArray(rectangles_xy, bounding_box) && expandArray(rectangles_xz, bounding_box) &&
+               expandArray(rectangles_yz, bounding_box);
+    }
+}
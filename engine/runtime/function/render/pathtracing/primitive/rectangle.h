@@ -3,17 +3,18 @@
 #include "runtime/function/render/pathtracing/common/util.h"
 
 #include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/common/spherical_sampling.h"
 
 namespace MiniEngine::PathTracing
 {
-    class RectangleXY : public Hittable
+    class RectangleXY final : public Hittable
     {
     public:
-        shared_ptr<Material> m;
+        const Material *m{nullptr};
         float x0, x1, y0, y1, k;
 
         RectangleXY(){};
-        RectangleXY(float _x0, float _x1, float _y0, float _y1, float _k, shared_ptr<Material> mat) : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), m(mat){};
+        RectangleXY(float _x0, float _x1, float _y0, float _y1, float _k, const Material *mat) : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), m(mat){};
 
         virtual bool aabb(AABB &bounding_box) const override
         {
@@ -24,17 +25,20 @@ namespace MiniEngine::PathTracing
         }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+        virtual float getPDF(const vec3 &origin, const vec3 &v) const override;
+        virtual vec3 random(const vec3 &origin) const override;
     };
 
-    class RectangleXZ : public Hittable
+    class RectangleXZ final : public Hittable
     {
     public:
-        shared_ptr<Material> m;
+        const Material *m{nullptr};
         float x0, x1, z0, z1, k;
 
         RectangleXZ() {}
 
-        RectangleXZ(float _x0, float _x1, float _z0, float _z1, float _k, shared_ptr<Material> mat) : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), m(mat){};
+        RectangleXZ(float _x0, float _x1, float _z0, float _z1, float _k, const Material *mat) : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), m(mat){};
 
         virtual bool aabb(AABB &bounding_box) const override {
             // The bounding box must have non-zero width in each dimension, so pad the Y
@@ -45,38 +49,20 @@ namespace MiniEngine::PathTracing
 
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
-
-        virtual float getPDF(const vec3 &origin, const vec3 &v) const override
-        {
-            HitRecord rec;
-            if (!this->hit(Ray(origin, v), EPS, INF, rec))
-            {   
-                // cout<<"hit fail"<<endl;
-                return 0;
-            }
-
-            auto area = (x1 - x0) * (z1 - z0);
-            auto distance_squared = rec.t * rec.t * pow(length(v), 2);
-            auto cosine = fabs(dot(v, rec.hit_point.Normal) / length(v));
-            return distance_squared / (cosine * area);
-        }
-
-        virtual vec3 random(const vec3 &origin) const override
-        {
-            auto random_point = vec3(linearRand(x0, x1), k, linearRand(z0, z1));
-            return random_point - origin;
-        }
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+        virtual float getPDF(const vec3 &origin, const vec3 &v) const override;
+        virtual vec3 random(const vec3 &origin) const override;
     };
 
-    class RectangleYZ : public Hittable
+    class RectangleYZ final : public Hittable
     {
     public:
-        shared_ptr<Material> m;
+        const Material *m{nullptr};
         float y0, y1, z0, z1, k;
 
         RectangleYZ() {}
 
-        RectangleYZ(float _y0, float _y1, float _z0, float _z1, float _k, shared_ptr<Material> mat) : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), m(mat){};
+        RectangleYZ(float _y0, float _y1, float _z0, float _z1, float _k, const Material *mat) : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), m(mat){};
 
          virtual bool aabb(AABB &bounding_box) const override {
             // The bounding box must have non-zero width in each dimension, so pad the X
@@ -86,9 +72,12 @@ namespace MiniEngine::PathTracing
         }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+        virtual float getPDF(const vec3 &origin, const vec3 &v) const override;
+        virtual vec3 random(const vec3 &origin) const override;
     };
 
-    bool RectangleXY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool RectangleXY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         auto t = (k - r.origin.z) / r.direction.z;
         if (t < t_min || t > t_max)
@@ -98,14 +87,19 @@ namespace MiniEngine::PathTracing
         if (x < x0 || x > x1 || y < y0 || y > y1)
             return false;
         rec.t = t;
+        rec.prim = rec.object = this;
+        return true;
+    }
+
+    inline void RectangleXY::fillHit(const Ray &r, HitRecord &rec) const
+    {
         auto outward_normal = vec3(0, 0, 1);
         rec.setFaceNormal(r, outward_normal);
         rec.mat_ptr = m;
-        rec.hit_point.Position = r.cast(t);
-        return true;
+        rec.hit_point.Position = r.cast(rec.t);
     }
 
-    bool RectangleXZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool RectangleXZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         auto t = (k - r.origin.y) / r.direction.y;
         if (t < t_min || t > t_max)
@@ -115,14 +109,19 @@ namespace MiniEngine::PathTracing
         if (x < x0 || x > x1 || z < z0 || z > z1)
             return false;
         rec.t = t;
+        rec.prim = rec.object = this;
+        return true;
+    }
+
+    inline void RectangleXZ::fillHit(const Ray &r, HitRecord &rec) const
+    {
         auto outward_normal = vec3(0, 1, 0);
         rec.setFaceNormal(r, outward_normal);
         rec.mat_ptr = m;
-        rec.hit_point.Position = r.cast(t);
-        return true;
+        rec.hit_point.Position = r.cast(rec.t);
     }
 
-    bool RectangleYZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool RectangleYZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         auto t = (k - r.origin.x) / r.direction.x;
         if (t < t_min || t > t_max)
@@ -132,10 +131,48 @@ namespace MiniEngine::PathTracing
         if (y < y0 || y > y1 || z < z0 || z > z1)
             return false;
         rec.t = t;
+        rec.prim = rec.object = this;
+        return true;
+    }
+
+    inline void RectangleYZ::fillHit(const Ray &r, HitRecord &rec) const
+    {
         auto outward_normal = vec3(1, 0, 0);
         rec.setFaceNormal(r, outward_normal);
         rec.mat_ptr = m;
-        rec.hit_point.Position = r.cast(t);
-        return true;
+        rec.hit_point.Position = r.cast(rec.t);
+    }
+
+    inline float RectangleXY::getPDF(const vec3 &origin, const vec3 &v) const
+    {
+        return SphericalRectangle(origin, vec3(x0, y0, k), vec3(x1 - x0, 0, 0), vec3(0, y1 - y0, 0)).getPDF(v);
+    }
+
+    inline vec3 RectangleXY::random(const vec3 &origin) const
+    {
+        vec2 u(linearRand(0.f, 1.f), linearRand(0.f, 1.f));
+        return SphericalRectangle(origin, vec3(x0, y0, k), vec3(x1 - x0, 0, 0), vec3(0, y1 - y0, 0)).sample(u);
+    }
+
+    inline float RectangleXZ::getPDF(const vec3 &origin, const vec3 &v) const
+    {
+        return SphericalRectangle(origin, vec3(x0, k, z0), vec3(x1 - x0, 0, 0), vec3(0, 0, z1 - z0)).getPDF(v);
+    }
+
+    inline vec3 RectangleXZ::random(const vec3 &origin) const
+    {
+        vec2 u(linearRand(0.f, 1.f), linearRand(0.f, 1.f));
+        return SphericalRectangle(origin, vec3(x0, k, z0), vec3(x1 - x0, 0, 0), vec3(0, 0, z1 - z0)).sample(u);
+    }
+
+    inline float RectangleYZ::getPDF(const vec3 &origin, const vec3 &v) const
+    {
+        return SphericalRectangle(origin, vec3(k, y0, z0), vec3(0, y1 - y0, 0), vec3(0, 0, z1 - z0)).getPDF(v);
+    }
+
+    inline vec3 RectangleYZ::random(const vec3 &origin) const
+    {
+        vec2 u(linearRand(0.f, 1.f), linearRand(0.f, 1.f));
+        return SphericalRectangle(origin, vec3(k, y0, z0), vec3(0, y1 - y0, 0), vec3(0, 0, z1 - z0)).sample(u);
     }
 }
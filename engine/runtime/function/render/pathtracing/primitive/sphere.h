@@ -4,21 +4,23 @@
 
 namespace MiniEngine::PathTracing
 {
-    class Sphere : public Hittable
+    class Sphere final : public Hittable
     {
     public:
         vec3 center;
         float radius;
-        shared_ptr<Material> mat_ptr;
+        const Material *mat_ptr{nullptr};
 
     public:
         Sphere() {}
-        Sphere(vec3 cen, float r, shared_ptr<Material> m) : center(cen), radius(r), mat_ptr(m){};
+        Sphere(vec3 cen, float r, const Material *m) : center(cen), radius(r), mat_ptr(m){};
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
     };
 
-    bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         vec3 oc = r.origin - center;
         auto a = dot(r.direction, r.direction);
@@ -40,12 +42,22 @@ namespace MiniEngine::PathTracing
         }
 
         rec.t = root;
+        rec.prim = rec.object = this;
+
+        return true;
+    }
+
+    inline void Sphere::fillHit(const Ray &r, HitRecord &rec) const
+    {
         rec.hit_point.Position = r.cast(rec.t);
         vec3 outward_normal = (rec.hit_point.Position - center) / radius;
         rec.setFaceNormal(r, outward_normal);
         rec.mat_ptr = mat_ptr;
+    }
 
+    inline bool Sphere::aabb(AABB &bounding_box) const
+    {
+        bounding_box = AABB(center - vec3(fabs(radius)), center + vec3(fabs(radius)));
         return true;
     }
-
 }
@@ -1,54 +1,38 @@
 #pragma once
 
 #include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/common/spherical_sampling.h"
 
 #include <glm/gtx/string_cast.hpp>
+#include <array>
 
 namespace MiniEngine::PathTracing
 {
-    class Triangle : public Hittable
+    class Triangle final : public Hittable
     {
     public:
-        vector<Vertex> vertices;
-        shared_ptr<Material> mat_ptr;
+        std::array<Vertex, 3> vertices;
+        const Material *mat_ptr{nullptr}; // owned by the model data
+        uint32_t material_id{0};
 
         Triangle() {}
-        Triangle(vector<Vertex> vt, shared_ptr<Material> m) : vertices(vt), mat_ptr(m){};
+        Triangle(const std::array<Vertex, 3> &vt, const Material *m, uint32_t id = 0) : vertices(vt), mat_ptr(m), material_id(id){};
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
         virtual bool aabb(AABB &output_box) const override;
+        virtual void splitAABB(int axis, float position, const AABB &box, AABB &left, AABB &right) const override;
+        virtual void fillHit(const Ray &r, HitRecord &rec) const override;
+        virtual bool getTriangle(vec3 &v0, vec3 &v1, vec3 &v2) const override;
 
         virtual float getPDF(const vec3 &origin, const vec3 &v) const override
         {
-            HitRecord rec;
-            if (!this->hit(Ray(origin, v), EPS, INF, rec))
-                return 0;
-
-            float area = getArea();
-
-            float distance_squared = rec.t * rec.t * pow(length(v), 2);
-            float cosine = fabs(dot(v, rec.hit_point.Normal) / length(v));
-
-            return distance_squared / (cosine * area);
+            return SphericalTriangle(origin, vertices[0].Position, vertices[1].Position, vertices[2].Position).getPDF(v);
         }
 
         virtual vec3 random(const vec3 &origin) const override
         {
-
-            vec3 edge1 = vertices[1].Position - vertices[0].Position;
-            vec3 edge2 = vertices[2].Position - vertices[0].Position;
-
-            auto u = linearRand(0.f, 1.f);
-            auto v = linearRand(0.f, 1.f);
-
-            vec3 random_point;
-
-            if (u + v > 1)
-                random_point = vertices[0].Position + (1 - u) * edge1 + (1 - v) * edge2;
-            else
-                random_point = vertices[0].Position + u * edge1 + v * edge2;
-
-            return random_point - origin;
+            vec2 u(linearRand(0.f, 1.f), linearRand(0.f, 1.f));
+            return SphericalTriangle(origin, vertices[0].Position, vertices[1].Position, vertices[2].Position).sample(u);
         }
 
         virtual float getArea() const override
@@ -67,7 +51,7 @@ namespace MiniEngine::PathTracing
         }
     };
 
-    bool Triangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool Triangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         // ray intersection
         vec3 edge1 = vertices[1].Position - vertices[0].Position;
@@ -79,7 +63,7 @@ namespace MiniEngine::PathTracing
         if (fabs(a) < EPS * EPS)
             return false;
 
-        auto f = 1.0 / a;
+        auto f = 1.f / a;
         auto s = r.origin - vertices[0].Position;
         auto u = f * dot(s, q);
 
@@ -97,16 +81,48 @@ namespace MiniEngine::PathTracing
             return false;
 
         rec.t = t;
+        rec.u = u;
+        rec.v = v;
+        rec.prim = rec.object = this;
+
+        return true;
+    }
+
+    inline bool Triangle::getTriangle(vec3 &v0, vec3 &v1, vec3 &v2) const
+    {
+        v0 = vertices[0].Position;
+        v1 = vertices[1].Position;
+        v2 = vertices[2].Position;
+        return true;
+    }
+
+    inline void Triangle::fillHit(const Ray &r, HitRecord &rec) const
+    {
+        vec3 edge1 = vertices[1].Position - vertices[0].Position;
+        vec3 edge2 = vertices[2].Position - vertices[0].Position;
+
         rec.hit_point.Position = r.cast(rec.t);
-        rec.hit_point.Texcoord = interpTexcoord(u, v);
+        rec.hit_point.Texcoord = interpTexcoord(rec.u, rec.v);
         vec3 outward_normal = normalize(cross(edge1, edge2));
         rec.setFaceNormal(r, outward_normal);
         rec.mat_ptr = mat_ptr;
-
-        return true;
+        rec.material_id = material_id;
+
+        // the position as a function of the texture coordinates, left zero for triangles without a mapping
+        vec2 duv02 = vertices[0].Texcoord - vertices[2].Texcoord;
+        vec2 duv12 = vertices[1].Texcoord - vertices[2].Texcoord;
+        vec3 dp02 = vertices[0].Position - vertices[2].Position;
+        vec3 dp12 = vertices[1].Position - vertices[2].Position;
+        float det = duv02[0] * duv12[1] - duv02[1] * duv12[0];
+        if (fabs(det) > 1e-12f)
+        {
+            float inv_det = 1.f / det;
+            rec.dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * inv_det;
+            rec.dpdv = (duv02[0] * dp12 - duv12[0] * dp02) * inv_det;
+        }
     }
 
-    bool Triangle::aabb(AABB &bounding_box) const
+    inline bool Triangle::aabb(AABB &bounding_box) const
     {
         auto x_min = min({vertices[0].Position.x, vertices[1].Position.x, vertices[2].Position.x}) - EPS;
         auto y_min = min({vertices[0].Position.y, vertices[1].Position.y, vertices[2].Position.y}) - EPS;
@@ -121,4 +137,41 @@ namespace MiniEngine::PathTracing
         return true;
     }
 
+    inline void Triangle::splitAABB(int axis, float position, const AABB &box, AABB &left, AABB &right) const
+    {
+        left = AABB::empty();
+        right = AABB::empty();
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const vec3 &v0 = vertices[i].Position;
+            const vec3 &v1 = vertices[(i + 1) % 3].Position;
+
+            if (v0[axis] <= position)
+                left.expand(v0);
+            if (v0[axis] >= position)
+                right.expand(v0);
+
+            // an edge crossing the plane adds the crossing point to both sides
+            if ((v0[axis] < position && position < v1[axis]) || (v1[axis] < position && position < v0[axis]))
+            {
+                vec3 p = mix(v0, v1, (position - v0[axis]) / (v1[axis] - v0[axis]));
+                p[axis] = position;
+                left.expand(p);
+                right.expand(p);
+            }
+        }
+
+        // pad like aabb() does, then keep each part on its side and inside the reference being split
+        AABB left_bound = box;
+        AABB right_bound = box;
+        left_bound.max[axis] = position;
+        right_bound.min[axis] = position;
+
+        left = AABB(left.min - EPS, left.max + EPS);
+        right = AABB(right.min - EPS, right.max + EPS);
+        left.intersect(left_bound);
+        right.intersect(right_bound);
+    }
+
 }
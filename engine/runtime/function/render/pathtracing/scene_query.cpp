@@ -0,0 +1,226 @@
+#include "runtime/function/render/pathtracing/scene_query.h"
+#include "runtime/function/render/pathtracing/primitive/primitive_set.h"
+#include "runtime/function/render/pathtracing/primitive/instance.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+namespace MiniEngine::PathTracing
+{
+    Frustum Frustum::fromMatrix(const mat4 &proj_view)
+    {
+        // Gribb and Hartmann, the planes are sums and differences of the rows of the matrix
+        mat4 m = transpose(proj_view);
+
+        Frustum frustum;
+        frustum.planes[0] = m[3] + m[0];
+        frustum.planes[1] = m[3] - m[0];
+        frustum.planes[2] = m[3] + m[1];
+        frustum.planes[3] = m[3] - m[1];
+        frustum.planes[4] = m[3] + m[2];
+        frustum.planes[5] = m[3] - m[2];
+        return frustum;
+    }
+
+    bool Frustum::overlaps(const AABB &box) const
+    {
+        // conservative, a box is only rejected if it lies completely outside one of the planes
+        for (const vec4 &plane : planes)
+        {
+            vec3 corner(plane.x >= 0.f ? box.max.x : box.min.x,
+                        plane.y >= 0.f ? box.max.y : box.min.y,
+                        plane.z >= 0.f ? box.max.z : box.min.z);
+            if (dot(vec3(plane), corner) + plane.w < 0.f)
+                return false;
+        }
+        return true;
+    }
+
+    shared_ptr<SceneQuery::ModelGeometry> SceneQuery::getGeometry(const shared_ptr<Model> &model)
+    {
+        auto found = models.find(model);
+        if (found != models.end())
+            return found->second;
+
+        // positions only, queries never shade
+        auto geometry = make_shared<ModelGeometry>();
+        geometry->primitives = make_shared<PrimitiveSet>();
+        for (const auto &mesh : model->meshes)
+        {
+            for (size_t id = 0; id + 2 < mesh.indices.size(); id += 3)
+            {
+                std::array<Vertex, 3> vertices{};
+                for (int k = 0; k < 3; ++k)
+                    vertices[k].Position = mesh.vertices[mesh.indices[id + k]].Position;
+                geometry->primitives->add(Triangle(vertices, nullptr));
+            }
+        }
+
+        if (geometry->primitives->size() > 0)
+        {
+            geometry->blas = make_shared<BVH>(*geometry->primitives);
+            geometry->blas->packLeaves();
+        }
+
+        models[model] = geometry;
+        return geometry;
+    }
+
+    bool SceneQuery::update(const vector<ModelInstance> &instances)
+    {
+        std::lock_guard<std::mutex> lock(update_mutex);
+
+        shared_ptr<const Snapshot> current = getSnapshot();
+        if (current && current->instances.size() == instances.size())
+        {
+            bool same = true;
+            for (size_t i = 0; i < instances.size() && same; ++i)
+            {
+                const ModelInstance &a = current->instances[i];
+                const ModelInstance &b = instances[i];
+                same = a.model == b.model && a.transform == b.transform && a.object_id == b.object_id;
+            }
+            if (same)
+                return false;
+        }
+
+        auto scene = make_shared<Snapshot>();
+        scene->instances = instances;
+        scene->geometry.resize(instances.size());
+        for (uint32_t i = 0; i < instances.size(); ++i)
+        {
+            if (!instances[i].model)
+                continue;
+
+            scene->geometry[i] = getGeometry(instances[i].model);
+            if (!scene->geometry[i]->blas)
+                continue;
+
+            auto instance = make_shared<Instance>(scene->geometry[i]->blas, instances[i].transform);
+            scene->placed_index[instance.get()] = i;
+            scene->placed.add(instance);
+        }
+        if (!scene->placed.objects.empty())
+            scene->tlas = make_shared<BVH>(scene->placed);
+
+        // models no longer placed anywhere give their geometry back
+        for (auto it = models.begin(); it != models.end();)
+        {
+            bool used = false;
+            for (const auto &instance : instances)
+                used = used || instance.model == it->first;
+            it = used ? std::next(it) : models.erase(it);
+        }
+
+        std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+        snapshot = scene;
+        return true;
+    }
+
+    void SceneQuery::clear()
+    {
+        std::lock_guard<std::mutex> lock(update_mutex);
+        models.clear();
+
+        std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+        snapshot.reset();
+    }
+
+    shared_ptr<const SceneQuery::Snapshot> SceneQuery::getSnapshot() const
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex);
+        return snapshot;
+    }
+
+    bool SceneQuery::hitSnapshot(const Snapshot &scene, const Ray &r, float t_max, SceneHit &hit)
+    {
+        HitRecord rec;
+        if (!scene.tlas || !scene.tlas->hit(r, 0.f, t_max, rec))
+            return false;
+
+        rec.resolve(r);
+        uint32_t instance = scene.placed_index.at(rec.object);
+
+        hit.t = rec.t;
+        hit.position = rec.hit_point.Position;
+        hit.normal = rec.hit_point.Normal;
+        hit.instance = instance;
+        hit.object_id = scene.instances[instance].object_id;
+        return true;
+    }
+
+    bool SceneQuery::closestHit(const Ray &r, SceneHit &hit, float t_max) const
+    {
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        return scene && hitSnapshot(*scene, r, t_max, hit);
+    }
+
+    bool SceneQuery::anyHit(const Ray &r, float t_max) const
+    {
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        return scene && scene->tlas && scene->tlas->occluded(r, 0.f, t_max);
+    }
+
+    void SceneQuery::closestHits(const vector<Ray> &rays, vector<SceneHit> &hits, vector<uint8_t> &hit_mask) const
+    {
+        hits.resize(rays.size());
+        hit_mask.assign(rays.size(), 0);
+
+        // one snapshot for the whole batch, even if the scene is updated meanwhile
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        if (!scene)
+            return;
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size()),
+                          [&](const tbb::blocked_range<size_t> &range)
+                          {
+                              for (size_t i = range.begin(); i != range.end(); ++i)
+                                  hit_mask[i] = hitSnapshot(*scene, rays[i], INF, hits[i]);
+                          });
+    }
+
+    void SceneQuery::overlap(const AABB &box, vector<uint32_t> &instances) const
+    {
+        instances.clear();
+
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        if (!scene || !scene->tlas)
+            return;
+
+        scene->tlas->collect([&](const AABB &node_box)
+                             {
+                                 AABB common = node_box;
+                                 common.intersect(box);
+                                 return !common.isEmpty();
+                             },
+                             instances);
+
+        // the top level references placed objects, map them back to the order of the update
+        for (uint32_t &instance : instances)
+            instance = scene->placed_index.at(scene->placed.objects[instance].get());
+        std::sort(instances.begin(), instances.end());
+    }
+
+    void SceneQuery::overlap(const Frustum &frustum, vector<uint32_t> &instances) const
+    {
+        instances.clear();
+
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        if (!scene || !scene->tlas)
+            return;
+
+        scene->tlas->collect([&](const AABB &node_box)
+                             { return frustum.overlaps(node_box); },
+                             instances);
+
+        for (uint32_t &instance : instances)
+            instance = scene->placed_index.at(scene->placed.objects[instance].get());
+        std::sort(instances.begin(), instances.end());
+    }
+
+    size_t SceneQuery::getObjectId(uint32_t instance) const
+    {
+        shared_ptr<const Snapshot> scene = getSnapshot();
+        if (!scene || instance >= scene->instances.size())
+            return INVALID_OBJECT_ID;
+        return scene->instances[instance].object_id;
+    }
+}
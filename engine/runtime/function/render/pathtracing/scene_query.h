@@ -0,0 +1,82 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/path_tracer.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace MiniEngine::PathTracing
+{
+    class PrimitiveSet;
+
+    struct SceneHit
+    {
+        float t;
+        vec3 position;
+        vec3 normal;       // facing the ray
+        uint32_t instance; // index into the instances given to the last update
+        size_t object_id;  // object_id of that instance
+    };
+
+    // Six planes (a, b, c, d), a point is inside where a * x + b * y + c * z + d >= 0 for all of them
+    struct Frustum
+    {
+        vec4 planes[6];
+
+        // from a projection * view matrix, the frustum of an OpenGL camera
+        static Frustum fromMatrix(const mat4 &proj_view);
+        bool overlaps(const AABB &box) const;
+    };
+
+    // Ray and region queries against the scene for picking and editor tools, using the same BVHs as the path
+    // tracer. The geometry of every model is built once and kept across updates, an update only rebuilds the top
+    // level over the placements. Updates publish immutable snapshots, so any thread can query without locking
+    // against the scene as it was when the query started.
+    class SceneQuery
+    {
+    public:
+        // returns false if the instances match the current snapshot and nothing had to be rebuilt
+        bool update(const vector<ModelInstance> &instances);
+        void clear();
+
+        bool closestHit(const Ray &r, SceneHit &hit, float t_max = INF) const;
+        bool anyHit(const Ray &r, float t_max = INF) const;
+        // hits[i] is only filled in where hit_mask[i] is set
+        void closestHits(const vector<Ray> &rays, vector<SceneHit> &hits, vector<uint8_t> &hit_mask) const;
+
+        // instances whose world bounds overlap the region, as indices into the instances given to the last update
+        void overlap(const AABB &box, vector<uint32_t> &instances) const;
+        void overlap(const Frustum &frustum, vector<uint32_t> &instances) const;
+
+        size_t getObjectId(uint32_t instance) const;
+
+    private:
+        // object space triangles of one model and the BVH over them
+        struct ModelGeometry
+        {
+            shared_ptr<PrimitiveSet> primitives;
+            shared_ptr<BVH> blas;
+        };
+
+        struct Snapshot
+        {
+            vector<ModelInstance> instances;
+            vector<shared_ptr<ModelGeometry>> geometry;
+            HittableList placed;
+            std::unordered_map<const Hittable *, uint32_t> placed_index;
+            shared_ptr<BVH> tlas;
+        };
+
+        std::map<shared_ptr<Model>, shared_ptr<ModelGeometry>> models;
+        std::mutex update_mutex;
+
+        shared_ptr<const Snapshot> snapshot;
+        mutable std::mutex snapshot_mutex;
+
+        shared_ptr<const Snapshot> getSnapshot() const;
+        shared_ptr<ModelGeometry> getGeometry(const shared_ptr<Model> &model);
+        static bool hitSnapshot(const Snapshot &scene, const Ray &r, float t_max, SceneHit &hit);
+    };
+}
@@ -34,6 +34,7 @@ namespace MiniEngine
         vector<Mesh> meshes;
         vector<Material> mats;
         string model_path;
+        string model_file;
 
         // constructor, expects a filepath to a 3D model.
         Model(string const &path)
@@ -58,6 +59,7 @@ namespace MiniEngine
             tinyobj::ObjReaderConfig reader_config;
             reader_config.mtl_search_path = directory.generic_string().data();
             model_path = directory.generic_string();
+            model_file = path;
 
             tinyobj::ObjReader reader;
 
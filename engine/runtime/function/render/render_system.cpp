@@ -14,6 +14,13 @@
 #include "runtime/function/render/render_swap_context.h"
 #include "runtime/function/render/render_resource.h"
 #include "runtime/function/render/pathtracing/path_tracer.h"
+#include "runtime/function/render/pathtracing/scene_query.h"
+#include "runtime/function/render/pathtracing/common/camera.h"
+#include "runtime/function/framework/world/world_manager.h"
+#include "runtime/function/framework/scene/scene.h"
+#include "runtime/function/framework/object/object.h"
+#include "runtime/function/framework/component/mesh/mesh_component.h"
+#include "runtime/function/framework/component/transform/transform_component.h"
 
 namespace MiniEngine
 {
@@ -64,6 +71,12 @@ namespace MiniEngine
 
         // init path tracer
         m_path_tracer = std::make_shared<PathTracing::PathTracer>();
+        if (!global_rendering_res.m_environment_map.empty())
+        {
+            std::string environment_map = asset_manager->getFullPath(global_rendering_res.m_environment_map).generic_string();
+            strncpy(m_path_tracer->init_info->EnvironmentMap, environment_map.c_str(), sizeof(m_path_tracer->init_info->EnvironmentMap) - 1);
+        }
+        m_scene_query = std::make_shared<PathTracing::SceneQuery>();
     }
 
     void RenderSystem::tick(float delta_time)
@@ -180,15 +193,119 @@ namespace MiniEngine
         {
             m_render_model.reset();
         }
+        if (m_scene_query)
+        {
+            m_scene_query->clear();
+        }
+        m_instance_models.clear();
     }
 
     void RenderSystem::startRendering()
     {
+        std::vector<PathTracing::ModelInstance> instances;
+        if (m_render_model)
+        {
+            instances.push_back({m_render_model, glm::mat4(1.f)});
+        }
+        collectSceneInstances(instances);
+
         m_path_tracer->should_stop_tracing = false;
-        m_tracing_process = std::thread(&PathTracing::PathTracer::startTracing,m_path_tracer,m_render_model,m_render_camera);
+        if (m_path_tracer->init_info->Sequence && !m_path_tracer->camera_path.empty())
+        {
+            // the editor may change the path while the sequence renders, the sequence keeps its copy
+            m_path_tracer->in_sequence = true;
+            m_tracing_process = std::thread(&PathTracing::PathTracer::startSequence, m_path_tracer, instances, m_render_camera, m_path_tracer->camera_path);
+        }
+        else
+            m_tracing_process = std::thread(&PathTracing::PathTracer::startTracing,m_path_tracer,instances,m_render_camera);
         m_tracing_process.detach();
     };
 
+    void RenderSystem::collectSceneInstances(std::vector<PathTracing::ModelInstance>& instances)
+    {
+        std::shared_ptr<Scene> scene = g_runtime_global_context.m_world_manager->getCurrentActiveScene().lock();
+        if (!scene)
+            return;
+
+        // a different scene starts with an empty cache, so models of the last one are released
+        if (m_instance_scene.lock() != scene)
+        {
+            m_instance_models.clear();
+            m_instance_scene = scene;
+        }
+
+        for (const auto& id_object_pair : scene->getAllGObjects())
+        {
+            const std::shared_ptr<GObject>& object = id_object_pair.second;
+            if (!object)
+                continue;
+
+            MeshComponent*      mesh_component      = object->tryGetComponent(MeshComponent);
+            TransformComponent* transform_component = object->tryGetComponent(TransformComponent);
+            if (!mesh_component || !transform_component)
+                continue;
+
+            // every mesh file is loaded once and shared by all objects placing it, until the file changes
+            for (const GameObjectPartDesc& mesh_part : mesh_component->getRawMeshes())
+            {
+                // the mesh component resolved the path through the asset manager already, the path tracer only
+                // reads obj files, json mesh data is left to the rasterizer
+                const std::string& mesh_file = mesh_part.m_mesh_desc.m_mesh_file;
+                if (std::filesystem::path(mesh_file).extension() != ".obj")
+                    continue;
+
+                std::error_code                 error;
+                std::filesystem::file_time_type write_time = std::filesystem::last_write_time(mesh_file, error);
+                if (error)
+                    write_time = std::filesystem::file_time_type::min();
+
+                auto [iter, inserted] = m_instance_models.try_emplace(mesh_file);
+                InstanceModel& entry  = iter->second;
+                if (inserted || entry.write_time != write_time)
+                {
+                    entry.write_time = write_time;
+                    entry.model      = error ? nullptr : std::make_shared<Model>(mesh_file);
+                    if (entry.model && entry.model->meshes.empty())
+                        entry.model.reset();
+                    if (!entry.model)
+                        LOG_WARN("path tracer skips mesh {}, it could not be loaded", mesh_file);
+                }
+                if (!entry.model)
+                    continue;
+
+                Matrix4x4 transform = transform_component->getMatrix() * mesh_part.m_transform_desc.m_transform_matrix;
+                instances.push_back({entry.model, transform.to_glm(), object->getID()});
+            }
+        }
+    }
+
+    void RenderSystem::updateSceneQuery()
+    {
+        std::vector<PathTracing::ModelInstance> instances;
+        if (m_render_model)
+        {
+            instances.push_back({m_render_model, glm::mat4(1.f)});
+        }
+        collectSceneInstances(instances);
+
+        m_scene_query->update(instances);
+    }
+
+    size_t RenderSystem::getGuidOfPickedMesh(const Vector2& picked_uv)
+    {
+        updateSceneQuery();
+
+        // same pinhole the path tracer shoots its primary rays from
+        glm::vec3 lookfrom = m_render_camera->Position;
+        PathTracing::Camera laser(lookfrom, lookfrom + m_render_camera->Front, glm::vec3(0.f, 1.f, 0.f),
+                                  m_render_camera->Zoom, 0.f, 1.f, m_render_camera->Aspect);
+
+        PathTracing::SceneHit hit;
+        if (!m_scene_query->closestHit(laser.getRay(picked_uv.x, 1.f - picked_uv.y), hit))
+            return k_invalid_gobject_id;
+        return hit.object_id;
+    }
+
     void RenderSystem::stopRendering()
     {
         m_path_tracer->should_stop_tracing = true;
@@ -210,6 +327,11 @@ namespace MiniEngine
         return m_path_tracer;
     }
 
+    std::shared_ptr<PathTracing::SceneQuery> RenderSystem::getSceneQuery() const
+    {
+        return m_scene_query;
+    }
+
     void RenderSystem::updateEngineContentViewport(float offset_x, float offset_y, float width, float height)
     {
         m_viewport.x = offset_x;
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <array>
+#include <filesystem>
 #include <memory>
 #include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -15,6 +19,7 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "runtime/core/math/vector2.h"
 #include "runtime/engine/engine.h"
 #include "runtime/function/render/render_entity.h"
 #include "runtime/function/render/render_guid_allocator.h"
@@ -32,6 +37,12 @@ namespace MiniEngine
     class Shader;
     class WindowUI;
     class Model;
+    class Scene;
+
+    namespace PathTracing
+    {
+        class SceneQuery;
+    }
 
     struct EngineContentViewport
     {
@@ -59,6 +70,12 @@ namespace MiniEngine
         std::shared_ptr<Model> getRenderModel() const;
         std::shared_ptr<Camera> getRenderCamera() const;
         std::shared_ptr<PathTracing::PathTracer> getPathTracer() const;
+        std::shared_ptr<PathTracing::SceneQuery> getSceneQuery() const;
+
+        // brings the scene query up to date with the loaded model and the objects of the active scene
+        void updateSceneQuery();
+        // object under the viewport position picked_uv, (0, 0) being the top left corner
+        size_t getGuidOfPickedMesh(const Vector2& picked_uv);
 
         void initializeUIRenderBackend(WindowUI* window_ui);
         void updateEngineContentViewport(float offset_x, float offset_y, float width, float height);
@@ -76,18 +93,29 @@ namespace MiniEngine
 
     private:
         void refreshFrameBuffer();
+        void collectSceneInstances(std::vector<PathTracing::ModelInstance>& instances);
 
         GLFWwindow *m_window;
         WindowUI *m_ui;
         EngineContentViewport m_viewport;
         std::thread m_tracing_process;
         std::shared_ptr<Model> m_render_model;
+        // models of the meshes placed in the scene by file, with the write time they were loaded at. Files that
+        // failed to load are kept without a model, so they are only tried again once they change.
+        struct InstanceModel
+        {
+            std::shared_ptr<Model>          model;
+            std::filesystem::file_time_type write_time;
+        };
+        std::unordered_map<std::string, InstanceModel> m_instance_models;
+        std::weak_ptr<Scene>                           m_instance_scene;
         std::shared_ptr<Canvas> m_render_canvas;
         std::shared_ptr<Shader> m_render_shader;
         std::shared_ptr<Shader> m_canvas_shader;
         std::shared_ptr<Camera> m_render_camera;
         std::shared_ptr<Camera> m_viewer_camera;
         std::shared_ptr<PathTracing::PathTracer> m_path_tracer;
+        std::shared_ptr<PathTracing::SceneQuery> m_scene_query;
 
         unsigned int texColorBuffer, texDepthBuffer, framebuffer= 0;
     };
@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 #include <stb_image.h>
 
+#include <cstring>
 #include <string>
 
 namespace MiniEngine
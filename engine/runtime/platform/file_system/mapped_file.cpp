@@ -0,0 +1,98 @@
+#include "runtime/platform/file_system/mapped_file.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MiniEngine
+{
+    MappedFile::~MappedFile() { close(); }
+
+    bool MappedFile::open(const std::filesystem::path& path)
+    {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file    = file;
+        m_mapping = mapping;
+        m_data    = static_cast<const unsigned char*>(view);
+        m_size    = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (view == MAP_FAILED)
+            return false;
+
+        m_data = static_cast<const unsigned char*>(view);
+        m_size = static_cast<size_t>(file_stat.st_size);
+#endif
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (!m_data)
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_file    = nullptr;
+        m_mapping = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+} // namespace MiniEngine
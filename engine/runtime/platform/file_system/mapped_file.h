@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace MiniEngine
+{
+    // Read only memory mapping of a whole file, unmapped when the object goes out of scope
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::filesystem::path& path);
+        void close();
+
+        bool                 isOpen() const { return m_data != nullptr; }
+        const unsigned char* data() const { return m_data; }
+        size_t               size() const { return m_size; }
+
+    private:
+        const unsigned char* m_data {nullptr};
+        size_t               m_size {0};
+#ifdef _WIN32
+        void* m_file {nullptr};
+        void* m_mapping {nullptr};
+#endif
+    };
+} // namespace MiniEngine
@@ -32,6 +32,10 @@ namespace MiniEngine
                 {
                     m_shader_folder = m_root_folder / value;
                 }
+                else if (name == "CacheFolder")
+                {
+                    m_cache_folder = m_root_folder / value;
+                }
                 else if (name == "SchemaFolder")
                 {
                     m_schema_folder = m_root_folder / value;
@@ -60,6 +64,8 @@ namespace MiniEngine
 
     const std::filesystem::path &ConfigManager::getShaderFolder() const { return m_shader_folder; }
 
+    const std::filesystem::path &ConfigManager::getCacheFolder() const { return m_cache_folder; }
+
     const std::filesystem::path& ConfigManager::getEditorFontPath() const { return m_editor_font_path; }
 
     const std::string &ConfigManager::getDefaultWorldUrl() const { return m_default_world_url; }
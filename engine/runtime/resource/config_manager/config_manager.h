@@ -15,6 +15,7 @@ namespace MiniEngine
         const std::filesystem::path& getAssetFolder() const;
         const std::filesystem::path& getShaderFolder() const;
         const std::filesystem::path& getSchemaFolder() const;
+        const std::filesystem::path& getCacheFolder() const;
         const std::filesystem::path& getEditorBigIconPath() const;
         const std::filesystem::path& getEditorSmallIconPath() const;
         const std::filesystem::path& getEditorFontPath() const;
@@ -27,6 +28,7 @@ namespace MiniEngine
         std::filesystem::path m_asset_folder;
         std::filesystem::path m_shader_folder;
         std::filesystem::path m_schema_folder;
+        std::filesystem::path m_cache_folder;
         std::filesystem::path m_editor_big_icon_path;
         std::filesystem::path m_editor_small_icon_path;
         std::filesystem::path m_editor_font_path;